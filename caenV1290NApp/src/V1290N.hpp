@@ -4,6 +4,11 @@
 
 #define MAX_CHANNELS 16
 
+// The Output Buffer is a 32k word FIFO mapped repeatedly over the first 4 kB of the board
+// address space, so consecutive addresses in this window read consecutive words.
+#define OUTBUF_WINDOW_BYTES 0x1000
+#define OUTBUF_MAX_WORDS 32768
+
 namespace Register {
 // Configuration & Status Registers
 static const uint16_t OutBuf = 0x0000;          // D32, R, Output Buffer
@@ -73,16 +78,157 @@ static const uint16_t ReadOk = (1 << 1);  // Data ready for Micro read
 } // namespace Handshake
 
 namespace Opcode {
+// Acquisition mode
 static const uint16_t SetTriggerMatch = 0x0000;
 static const uint16_t SetContinuous = 0x0100;
 static const uint16_t ReadAcquisitionMode = 0x0200;
+static const uint16_t SetKeepToken = 0x0300;
+static const uint16_t ClearKeepToken = 0x0400;
+static const uint16_t LoadDefaultConfig = 0x0500;
+static const uint16_t SaveUserConfig = 0x0600;
+static const uint16_t LoadUserConfig = 0x0700;
+static const uint16_t AutoloadUserConfig = 0x0800;
+static const uint16_t AutoloadDefaultConfig = 0x0900;
+
+// Trigger
+static const uint16_t SetWindowWidth = 0x1000;
+static const uint16_t SetWindowOffset = 0x1100;
+static const uint16_t SetSearchMargin = 0x1200;       // extra search window
+static const uint16_t SetRejectMargin = 0x1300;
+static const uint16_t EnableTriggerSubtraction = 0x1400;
+static const uint16_t DisableTriggerSubtraction = 0x1500;
+static const uint16_t ReadTriggerConfig = 0x1600;     // 5 words: width, offset, search, reject, subtraction
+
+// Edge detection and resolution
 static const uint16_t SetEdgeDetectionMode = 0x2200;
 static const uint16_t ReadEdgeDetectionMode = 0x2300;
+static const uint16_t SetEdgeResolution = 0x2400;     // LSB of leading/trailing edges
+static const uint16_t SetPairResolution = 0x2500;     // LSB of leading edge and width in pair mode
+static const uint16_t ReadResolution = 0x2600;
+static const uint16_t SetDeadTime = 0x2800;
+static const uint16_t ReadDeadTime = 0x2900;
+
+// TDC readout
 static const uint16_t EnableTDCHeaderTrailer = 0x3000;
 static const uint16_t DisableTDCHeaderTrailer = 0x3100;
 static const uint16_t TDCHeaderTrailerStatus = 0x3200;
+static const uint16_t SetEventSize = 0x3300;          // maximum hits per event
+static const uint16_t ReadEventSize = 0x3400;
+static const uint16_t EnableErrorMark = 0x3500;
+static const uint16_t DisableErrorMark = 0x3600;
+static const uint16_t EnableErrorBypass = 0x3700;
+static const uint16_t DisableErrorBypass = 0x3800;
+static const uint16_t SetErrorTypes = 0x3900;
+static const uint16_t ReadErrorTypes = 0x3A00;
+static const uint16_t SetFifoSize = 0x3B00;           // effective L1 FIFO size
+static const uint16_t ReadFifoSize = 0x3C00;
+
+// Channel enable, the low byte of the per-channel/per-TDC opcodes selects the channel or TDC
+static const uint16_t EnableChannel = 0x4000;
+static const uint16_t DisableChannel = 0x4100;
+static const uint16_t EnableAllChannels = 0x4200;
+static const uint16_t DisableAllChannels = 0x4300;
 static const uint16_t WriteEnablePattern = 0x4400;
 static const uint16_t ReadEnablePattern = 0x4500;
-static const uint16_t SetWindowWidth = 0x1000;
-static const uint16_t SetWindowOffset = 0x1100;
+static const uint16_t WriteEnablePattern32 = 0x4600;  // per TDC, 2 words
+static const uint16_t ReadEnablePattern32 = 0x4700;
+
+// Adjust
+static const uint16_t SetGlobalOffset = 0x5000;       // 2 words: coarse counter, fine counter
+static const uint16_t ReadGlobalOffset = 0x5100;
+static const uint16_t SetChannelAdjust = 0x5200;      // per channel
+static const uint16_t ReadChannelAdjust = 0x5300;
+static const uint16_t SetRcAdjust = 0x5400;           // per TDC
+static const uint16_t ReadRcAdjust = 0x5500;
+static const uint16_t SaveRcAdjust = 0x5600;
+
+// Miscellaneous
+static const uint16_t ReadTdcId = 0x6000;             // per TDC, 2 words
+static const uint16_t ReadMicroRevision = 0x6100;
+static const uint16_t ResetDllPll = 0x6200;
+
+static const uint16_t CodeMask = 0xFF00;              // opcode without the channel/TDC selector
+static const uint16_t SelectMask = 0x00FF;
 } // namespace Opcode
+
+namespace McstCblt {
+static const uint16_t AddrMask = 0xFF; // McstCbltAddr holds A31..A24 of the MCST/CBLT address
+static const uint16_t Disabled = 0x0;  // McstCbltCtrl: board not part of a chain
+static const uint16_t Last = 0x1;      // McstCbltCtrl: last board in the chain
+static const uint16_t First = 0x2;     // McstCbltCtrl: first board in the chain
+static const uint16_t Active = 0x3;    // McstCbltCtrl: intermediate board
+} // namespace McstCblt
+
+namespace EventFifo {
+static const uint32_t EventCountShift = 16;    // Event FIFO word bits 31..16: event count
+static const uint32_t EventCountMask = 0xFFFF;
+static const uint32_t WordCountMask = 0xFFFF;  // Event FIFO word bits 15..0: words in the event
+static const uint16_t StoredMask = 0x7FF;      // Event FIFO Stored bits 10..0
+static const uint16_t DataReady = (1 << 0);    // Event FIFO Status: FIFO not empty
+static const uint16_t Full = (1 << 1);         // Event FIFO Status: FIFO full
+} // namespace EventFifo
+
+namespace ReadoutMode {
+static const int D32 = 0;    // Single D32 cycles through devReadProbe (slow, always safe)
+static const int Blt32 = 1;  // 32-bit block transfer over the Output Buffer window
+static const int Mblt64 = 2; // 64-bit multiplexed block transfer (requires Control::Align64)
+} // namespace ReadoutMode
+
+namespace DataWord {
+static const uint32_t TypeShift = 27;         // Word type lives in bits 31..27
+static const uint32_t Measurement = 0x00;     // 00000: TDC measurement
+static const uint32_t TdcHeader = 0x01;       // 00001: TDC header
+static const uint32_t TdcTrailer = 0x03;      // 00011: TDC trailer
+static const uint32_t TdcError = 0x04;        // 00100: TDC error
+static const uint32_t GlobalHeader = 0x08;    // 01000: start of event
+static const uint32_t GlobalTrailer = 0x10;   // 10000: end of event
+static const uint32_t Ettt = 0x11;            // 10001: extended trigger time tag
+static const uint32_t Filler = 0x18;          // 11000: returned when the Output Buffer is empty
+
+// Global header
+static const uint32_t GeoMask = 0x1F;         // bits 4..0, also in the global trailer
+static const uint32_t EventCountShift = 5;    // bits 26..5
+static const uint32_t EventCountMask = 0x3FFFFF;
+
+// TDC header, trailer and error
+static const uint32_t TdcShift = 24;          // bits 25..24
+static const uint32_t TdcMask = 0x3;
+static const uint32_t EventIdShift = 12;      // bits 23..12
+static const uint32_t EventIdMask = 0xFFF;
+static const uint32_t BunchIdMask = 0xFFF;    // bits 11..0, header only
+static const uint32_t TdcWordCountMask = 0xFFF; // bits 11..0, trailer only
+static const uint32_t ErrorFlagsMask = 0x7FFF;  // bits 14..0
+
+// TDC measurement
+static const uint32_t EdgeShift = 26;         // bit 26, 1=trailing, 0=leading
+static const uint32_t ChannelShift = 21;      // bits 25..21
+static const uint32_t ChannelMask = 0x1F;
+static const uint32_t TimeMask = 0x1FFFFF;    // bits 20..0, 25 ps LSB at full resolution
+
+// Extended trigger time tag
+static const uint32_t EtttMask = 0x7FFFFFF;   // bits 26..0, 800 ns LSB
+static const uint32_t EtttLsbTdc = 32000;     // ETTT LSB in 25 ps TDC LSBs, the default resolution
+
+// Global trailer
+static const uint32_t StatusShift = 24;       // bits 26..24
+static const uint32_t StatusMask = 0x7;
+static const uint32_t WordCountShift = 5;     // bits 20..5
+static const uint32_t WordCountMask = 0xFFFF;
+} // namespace DataWord
+
+namespace Edge {
+static const uint8_t Leading = 0;
+static const uint8_t Trailing = 1;
+} // namespace Edge
+
+namespace EventFlag {
+static const uint32_t TdcErrorMask = 0x7FFF;     // bits 14..0: OR of all TDC error word flags
+static const uint32_t TdcError = (1 << 16);      // Global trailer status: a TDC reported an error
+static const uint32_t Overflow = (1 << 17);      // Global trailer status: Output Buffer overflow
+static const uint32_t TriggerLost = (1 << 18);   // Global trailer status: trigger lost
+static const uint32_t MissingHeader = (1 << 24); // Hits arrived without a global header
+static const uint32_t MissingTrailer = (1 << 25); // Next header arrived before the trailer
+static const uint32_t Truncated = (1 << 26);     // Hits dropped because the batch was full
+static const uint32_t NoTimestamp = (1 << 27);   // Hit timestamps are the hit times alone, see Decoder::time_scale()
+static const uint32_t Split = (1 << 28);         // Continuous mode frame too big for a batch, continues in the next event
+} // namespace EventFlag
@@ -0,0 +1,130 @@
+#pragma once
+#include <devLib.h>
+#include <epicsMMIO.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "V1290N.hpp"
+
+typedef void (*V1290NIsr)(void* arg);
+
+/// \brief Register-level access to one V1290N (or to an MCST/CBLT window).
+///
+/// Offsets are relative to the board base address. The checked accessors report bus errors;
+/// the Output Buffer accessors are unchecked and meant for block reads after a checked first
+/// word has shown the board is there.
+class V1290NBus {
+  public:
+    virtual ~V1290NBus() {}
+
+    /// \brief Performs a safe D16 read of the offset location
+    /// \return True on success, false on error
+    virtual bool read16(uint32_t offset, uint16_t& value) = 0;
+
+    /// \brief Performs a safe D16 write of the value to the offset
+    /// \return True on success, false on error
+    virtual bool write16(uint32_t offset, uint16_t value) = 0;
+
+    /// \brief Performs a safe D32 read of the offset location
+    /// \return True on success, false on error
+    virtual bool read32(uint32_t offset, uint32_t& value) = 0;
+
+    /// \brief Performs a safe D32 write of the value to the offset
+    /// \return True on success, false on error
+    virtual bool write32(uint32_t offset, uint32_t value) = 0;
+
+    /// \brief Unchecked D16 write of the value to the offset, safe to call from an ISR.
+    ///
+    /// The probed accessors may take locks or install exception hooks, which interrupt context
+    /// doesn't allow on vxWorks/RTEMS. The model only calls its ISR from a thread, so it can
+    /// use the checked write.
+    virtual void write16_isr(uint32_t offset, uint16_t value) { write16(offset, value); }
+
+    /// \brief Unchecked D32 read of Output Buffer word i (modulo the window size).
+    virtual uint32_t outbuf_word(size_t i) = 0;
+
+    /// \brief Unchecked 64-bit read of Output Buffer words i and i+1, stored in bus order.
+    virtual void outbuf_dword(size_t i, uint32_t* dst) = 0;
+
+    /// \brief Unchecked read of n consecutive Output Buffer words starting at word i.
+    virtual void outbuf_words(size_t i, uint32_t* dst, size_t n) {
+        for (size_t k = 0; k < n; k++) {
+            dst[k] = outbuf_word(i + k);
+        }
+    }
+
+    /// \brief Routes the board interrupt with the given vector and level to isr.
+    /// \return True on success, false on error.
+    virtual bool connect_interrupt(int level, int vector, V1290NIsr isr, void* arg) = 0;
+};
+
+/// \brief V1290NBus on a CPU-mapped VME A32 window through devLib.
+class VmeBus : public V1290NBus {
+  public:
+    /// \param owner Name registered with devLib for the address range.
+    /// \param address A32 base address.
+    /// \param extent Size of the window in bytes.
+    VmeBus(const char* owner, size_t address, size_t extent) : base(NULL) {
+        volatile void* ptr;
+        if (devRegisterAddress(owner, atVMEA32, address, extent, &ptr)) {
+            printf("ERROR: devRegisterAddress failed for 0x%08lX.\n", (unsigned long)address);
+            return;
+        }
+        base = (volatile uint8_t*)ptr;
+    }
+
+    /// \brief True if the address range was mapped.
+    bool ok() const { return base != NULL; }
+
+    virtual bool read16(uint32_t offset, uint16_t& value) {
+        return !devReadProbe(sizeof(uint16_t), base + offset, &value);
+    }
+
+    virtual bool write16(uint32_t offset, uint16_t value) {
+        return !devWriteProbe(sizeof(uint16_t), base + offset, &value);
+    }
+
+    virtual bool read32(uint32_t offset, uint32_t& value) {
+        return !devReadProbe(sizeof(uint32_t), base + offset, &value);
+    }
+
+    virtual bool write32(uint32_t offset, uint32_t value) {
+        return !devWriteProbe(sizeof(uint32_t), base + offset, &value);
+    }
+
+    virtual void write16_isr(uint32_t offset, uint16_t value) { nat_iowrite16(base + offset, value); }
+
+    virtual uint32_t outbuf_word(size_t i) {
+        return nat_ioread32(base + Register::OutBuf + ((i * sizeof(uint32_t)) & (OUTBUF_WINDOW_BYTES - 1)));
+    }
+
+    virtual void outbuf_dword(size_t i, uint32_t* dst) {
+        const uint64_t v = *(volatile const uint64_t*)(base + Register::OutBuf +
+                                                       ((i * sizeof(uint32_t)) & (OUTBUF_WINDOW_BYTES - 1)));
+        memcpy(dst, &v, sizeof(v));
+    }
+
+    virtual void outbuf_words(size_t i, uint32_t* dst, size_t n) {
+        for (size_t k = 0; k < n; k++) {
+            dst[k] = nat_ioread32(base + Register::OutBuf + (((i + k) * sizeof(uint32_t)) & (OUTBUF_WINDOW_BYTES - 1)));
+        }
+    }
+
+    virtual bool connect_interrupt(int level, int vector, V1290NIsr isr, void* arg) {
+        if (devConnectInterruptVME(vector, isr, arg)) {
+            printf("connect_interrupt: devConnectInterruptVME failed for vector 0x%X\n", vector);
+            return false;
+        }
+        if (devEnableInterruptLevelVME(level)) {
+            printf("connect_interrupt: devEnableInterruptLevelVME failed for level %d\n", level);
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    // this is a "trick" since adding an offset like 0x1000 to a pointer to uint8_t moves 4 bytes
+    volatile uint8_t* base;
+};
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "V1290NCoincidence.hpp"
+
+CoincidenceEngine::CoincidenceEngine() : channels_(0) {
+    CoincidenceConfig config;
+    config.start = -1;
+    config.stops = 0;
+    config.window_min = 0;
+    config.window_max = 4000;
+    config.hist_min = 0;
+    config.hist_width = 4;
+    config.hist_nbins = 1024;
+    for (int slot = 0; slot < MAX_COINCIDENCES; slot++) {
+        configure(slot, config);
+    }
+    memset(ntimes_, 0, sizeof(ntimes_));
+}
+
+void CoincidenceEngine::configure(int slot, const CoincidenceConfig& config) {
+    Slot& s = slots_[slot];
+    s.config = config;
+    if (s.config.start >= MAX_CHANNELS) {
+        s.config.start = -1;
+    }
+    if (s.config.start >= 0) {
+        // A hit always coincides with itself
+        s.config.stops &= ~(1 << s.config.start);
+    }
+    s.config.hist_width = config.hist_width ? config.hist_width : 1;
+    s.config.hist_nbins =
+        config.hist_nbins > MAX_HIST_BINS ? MAX_HIST_BINS : (config.hist_nbins ? config.hist_nbins : 1);
+    s.coincidences = 0;
+    s.pairs = 0;
+    memset(s.counts, 0, sizeof(s.counts));
+
+    channels_ = 0;
+    for (int i = 0; i < MAX_COINCIDENCES; i++) {
+        if (slots_[i].config.start >= 0 && slots_[i].config.stops) {
+            channels_ |= (1 << slots_[i].config.start) | slots_[i].config.stops;
+        }
+    }
+}
+
+void CoincidenceEngine::clear() {
+    for (int slot = 0; slot < MAX_COINCIDENCES; slot++) {
+        slots_[slot].coincidences = 0;
+        slots_[slot].pairs = 0;
+        memset(slots_[slot].counts, 0, sizeof(slots_[slot].counts));
+    }
+}
+
+void CoincidenceEngine::fill(const HitBatch& batch) {
+    if (!channels_) {
+        return;
+    }
+    for (size_t e = 0; e < batch.nevents; e++) {
+        fill_event(batch, e);
+    }
+}
+
+void CoincidenceEngine::fill_event(const HitBatch& batch, size_t e) {
+    memset(ntimes_, 0, sizeof(ntimes_));
+    const size_t first = batch.first_hit[e];
+    const size_t last = first + batch.hits[e];
+    for (size_t i = first; i < last; i++) {
+        const uint8_t ch = batch.channel[i];
+        if (ch < MAX_CHANNELS && batch.edge[i] == Edge::Leading && (channels_ >> ch) & 1 &&
+            ntimes_[ch] < COINC_MAX_HITS) {
+            times_[ch][ntimes_[ch]++] = batch.timestamp[i];
+        }
+    }
+
+    // The board sends each TDC's hits in time order, so this is usually a no-op pass
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        const uint64_t* t = times_[ch];
+        for (size_t i = 1; i < ntimes_[ch]; i++) {
+            if (t[i] < t[i - 1]) {
+                std::sort(times_[ch], times_[ch] + ntimes_[ch]);
+                break;
+            }
+        }
+    }
+
+    for (int slot = 0; slot < MAX_COINCIDENCES; slot++) {
+        Slot& s = slots_[slot];
+        if (s.config.start >= 0 && s.config.stops && ntimes_[s.config.start]) {
+            match(s);
+        }
+    }
+}
+
+void CoincidenceEngine::match(Slot& slot) {
+    const CoincidenceConfig& c = slot.config;
+    const uint64_t* starts = times_[c.start];
+    const size_t nstarts = ntimes_[c.start];
+    const uint64_t span = (uint64_t)c.hist_width * c.hist_nbins;
+
+    // First stop of each channel that can still be in the window of the current start
+    size_t lo[MAX_CHANNELS] = {0};
+
+    for (size_t i = 0; i < nstarts; i++) {
+        const uint64_t t0 = starts[i];
+        int wanted = 0;
+        int found = 0;
+        for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+            if (!((c.stops >> ch) & 1)) {
+                continue;
+            }
+            wanted++;
+            const uint64_t* stops = times_[ch];
+            const size_t nstops = ntimes_[ch];
+            // Starts are sorted, so stops before this start's window are before every later one's
+            while (lo[ch] < nstops && (int64_t)(stops[lo[ch]] - t0) < c.window_min) {
+                lo[ch]++;
+            }
+            bool any = false;
+            for (size_t k = lo[ch]; k < nstops; k++) {
+                const int64_t dt = (int64_t)(stops[k] - t0);
+                if (dt > c.window_max) {
+                    break;
+                }
+                any = true;
+                slot.pairs++;
+                const uint64_t offset = (uint64_t)(dt - c.hist_min);
+                if (dt >= c.hist_min && offset < span) {
+                    slot.counts[offset / c.hist_width]++;
+                }
+            }
+            found += any;
+        }
+        if (found == wanted) {
+            slot.coincidences++;
+        }
+    }
+}
+
+void CoincidenceEngine::axis(int slot, epicsFloat64* axis, double lsb_ns) const {
+    const CoincidenceConfig& c = slots_[slot].config;
+    for (size_t i = 0; i < c.hist_nbins; i++) {
+        axis[i] = (c.hist_min + (i + 0.5) * c.hist_width) * lsb_ns;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <epicsTypes.h>
+
+#include "V1290N.hpp"
+#include "V1290NDecoder.hpp"
+#include "V1290NHistogram.hpp"
+
+// Independent coincidence definitions, addressed by asyn address
+#define MAX_COINCIDENCES 8
+
+// Leading edges per channel and event considered, later ones are ignored
+#define COINC_MAX_HITS 1024
+
+/// \brief One start channel and the stop channels that must follow it.
+struct CoincidenceConfig {
+    int start;          // Start channel, -1 disables the coincidence
+    uint16_t stops;     // Mask of stop channels
+    int32_t window_min; // Accepted stop - start, in TDC LSBs
+    int32_t window_max;
+    int32_t hist_min;   // Binning of the stop - start histogram, in TDC LSBs
+    uint32_t hist_width;
+    size_t hist_nbins;
+};
+
+/// \brief Finds start/stop coincidences within each event and histograms their time differences.
+///
+/// For every leading edge on the start channel, each stop channel's leading edges with
+/// window_min <= stop - start <= window_max are paired with it and their difference (e.g. a
+/// time of flight) is histogrammed. The start hit counts as a coincidence when every stop
+/// channel contributed at least one pair, so a single stop channel gives start/stop pairs and
+/// several give tuples.
+///
+/// Hits are matched on their absolute timestamp, so continuous mode frames work the same as
+/// triggered events. Per event the edges of each channel are sorted once and matched with a
+/// sliding window, which keeps busy frames linear in the number of hits. Filled by the
+/// processing thread only; readers get a possibly-inconsistent snapshot.
+class CoincidenceEngine {
+  public:
+    CoincidenceEngine();
+
+    /// \brief Changes one coincidence definition and clears its results.
+    void configure(int slot, const CoincidenceConfig& config);
+
+    /// \brief Clears the results of every coincidence.
+    void clear();
+
+    /// \brief Adds all complete events in batch.
+    void fill(const HitBatch& batch);
+
+    const epicsInt32* counts(int slot) const { return slots_[slot].counts; }
+    size_t nbins(int slot) const { return slots_[slot].config.hist_nbins; }
+
+    /// \brief Start hits that found every stop channel.
+    size_t coincidences(int slot) const { return slots_[slot].coincidences; }
+
+    /// \brief Start/stop pairs inside the window, i.e. entries in the histogram or outside its range.
+    size_t pairs(int slot) const { return slots_[slot].pairs; }
+
+    /// \brief Fills axis with the bin centres in ns.
+    /// \param lsb_ns Hit time LSB in ns, see Decoder::lsb_ns().
+    void axis(int slot, epicsFloat64* axis, double lsb_ns) const;
+
+  private:
+    struct Slot {
+        CoincidenceConfig config;
+        size_t coincidences;
+        size_t pairs;
+        epicsInt32 counts[MAX_HIST_BINS];
+    };
+
+    void fill_event(const HitBatch& batch, size_t e);
+    void match(Slot& slot);
+
+    Slot slots_[MAX_COINCIDENCES];
+    uint16_t channels_; // Union of the channels used by enabled coincidences
+
+    // Leading edge timestamps of the current event, per channel
+    uint64_t times_[MAX_CHANNELS][COINC_MAX_HITS];
+    size_t ntimes_[MAX_CHANNELS];
+};
@@ -0,0 +1,251 @@
+#include <string.h>
+
+#include "V1290NColumnar.hpp"
+
+// Longest varint of a 64-bit value
+static const size_t VARINT_MAX_BYTES = 10;
+
+// Bits per packed ChannelEdge entry
+static const int CHANNEL_EDGE_BITS = 6;
+
+static inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+
+static inline int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+static inline uint8_t* put_varint(uint8_t* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/// \brief Reads one varint from [p, end).
+/// \return Pointer past the varint, NULL if it runs past end.
+static inline const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+size_t columnar_max_bytes(size_t nevents, size_t nhits) {
+    const size_t events = nevents * (4 * VARINT_MAX_BYTES + 5); // counters, flags, hits, geo
+    const size_t hits = nhits * 2 * 5 + (nhits * CHANNEL_EDGE_BITS + 7) / 8; // time, width, packed
+    return sizeof(ColumnarHeader) + events + hits + 3;
+}
+
+size_t columnar_encode(const HitBatch& batch, uint8_t* out) {
+    ColumnarHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = COLUMNAR_MAGIC;
+    hdr.nevents = (uint32_t)batch.nevents;
+    const size_t nhits = batch.nevents ? batch.first_hit[batch.nevents - 1] + batch.hits[batch.nevents - 1] : 0;
+    hdr.nhits = (uint32_t)nhits;
+    hdr.time_scale = batch.time_scale;
+    if (batch.nevents) {
+        hdr.first_event = batch.event_count[0];
+        hdr.last_event = batch.event_count[batch.nevents - 1];
+        hdr.first_trigger_time = batch.trigger_time[0];
+        hdr.last_trigger_time = batch.trigger_time[batch.nevents - 1];
+    }
+
+    uint8_t* p = out + sizeof(hdr);
+    uint8_t* start = p;
+
+    uint64_t last = hdr.first_event;
+    for (size_t e = 0; e < batch.nevents; e++) {
+        p = put_varint(p, zigzag((int64_t)(batch.event_count[e] - last)));
+        last = batch.event_count[e];
+    }
+    hdr.bytes[Column::EventCount] = (uint32_t)(p - start);
+    start = p;
+
+    last = hdr.first_trigger_time;
+    for (size_t e = 0; e < batch.nevents; e++) {
+        p = put_varint(p, zigzag((int64_t)(batch.trigger_time[e] - last)));
+        last = batch.trigger_time[e];
+    }
+    hdr.bytes[Column::TriggerTime] = (uint32_t)(p - start);
+    start = p;
+
+    for (size_t e = 0; e < batch.nevents; e++) {
+        p = put_varint(p, batch.flags[e]);
+    }
+    hdr.bytes[Column::Flags] = (uint32_t)(p - start);
+    start = p;
+
+    for (size_t e = 0; e < batch.nevents; e++) {
+        p = put_varint(p, batch.hits[e]);
+    }
+    hdr.bytes[Column::Hits] = (uint32_t)(p - start);
+    start = p;
+
+    for (size_t e = 0; e < batch.nevents; e++) {
+        p = put_varint(p, batch.geo[e]);
+    }
+    hdr.bytes[Column::Geo] = (uint32_t)(p - start);
+    start = p;
+
+    // Whole bytes are flushed from a 64-bit accumulator, so no entry straddles a store
+    uint64_t acc = 0;
+    int nbits = 0;
+    for (size_t i = 0; i < nhits; i++) {
+        acc |= (uint64_t)((batch.channel[i] & DataWord::ChannelMask) | (batch.edge[i] & 1) << 5) << nbits;
+        nbits += CHANNEL_EDGE_BITS;
+        while (nbits >= 8) {
+            *p++ = (uint8_t)acc;
+            acc >>= 8;
+            nbits -= 8;
+        }
+    }
+    if (nbits > 0) {
+        *p++ = (uint8_t)acc;
+    }
+    hdr.bytes[Column::ChannelEdge] = (uint32_t)(p - start);
+    start = p;
+
+    bool widths = false;
+    for (size_t e = 0; e < batch.nevents; e++) {
+        int32_t prev = 0;
+        const size_t first = batch.first_hit[e];
+        const size_t end = first + batch.hits[e];
+        for (size_t i = first; i < end; i++) {
+            // Continuous mode times can be slightly negative, so deltas are taken as signed
+            const int32_t t = (int32_t)batch.time[i];
+            p = put_varint(p, zigzag((int64_t)t - prev));
+            prev = t;
+            widths |= batch.width[i] != 0;
+        }
+    }
+    hdr.bytes[Column::Time] = (uint32_t)(p - start);
+    start = p;
+
+    if (widths) {
+        for (size_t i = 0; i < nhits; i++) {
+            p = put_varint(p, batch.width[i]);
+        }
+    }
+    hdr.bytes[Column::Width] = (uint32_t)(p - start);
+
+    while ((p - out) & 3) {
+        *p++ = 0;
+    }
+    memcpy(out, &hdr, sizeof(hdr));
+    return (size_t)(p - out);
+}
+
+bool columnar_decode(const uint8_t* in, size_t bytes, HitBatch& batch) {
+    ColumnarHeader hdr;
+    if (bytes < sizeof(hdr)) {
+        return false;
+    }
+    memcpy(&hdr, in, sizeof(hdr));
+    if (hdr.magic == COLUMNAR_MAGIC_V1) {
+        hdr.time_scale = DataWord::EtttLsbTdc;
+    } else if (hdr.magic != COLUMNAR_MAGIC) {
+        return false;
+    }
+    if (hdr.nevents > EVENT_BATCH_CAPACITY || hdr.nhits > HIT_BATCH_CAPACITY) {
+        return false;
+    }
+
+    const uint8_t* col[Column::Count + 1];
+    col[0] = in + sizeof(hdr);
+    for (int c = 0; c < Column::Count; c++) {
+        col[c + 1] = col[c] + hdr.bytes[c];
+        if (col[c + 1] > in + bytes || col[c + 1] < col[c]) {
+            return false;
+        }
+    }
+
+    const size_t nevents = hdr.nevents;
+    const size_t nhits = hdr.nhits;
+    uint64_t v = 0;
+    const uint8_t* p[Column::Count];
+    for (int c = 0; c < Column::Count; c++) {
+        p[c] = col[c];
+    }
+
+    uint64_t event_count = hdr.first_event;
+    uint64_t trigger_time = hdr.first_trigger_time;
+    size_t first = 0;
+    for (size_t e = 0; e < nevents; e++) {
+        if (!(p[Column::EventCount] = get_varint(p[Column::EventCount], col[Column::EventCount + 1], v))) {
+            return false;
+        }
+        event_count += unzigzag(v);
+        batch.event_count[e] = event_count;
+        if (!(p[Column::TriggerTime] = get_varint(p[Column::TriggerTime], col[Column::TriggerTime + 1], v))) {
+            return false;
+        }
+        trigger_time += unzigzag(v);
+        batch.trigger_time[e] = trigger_time;
+        if (!(p[Column::Flags] = get_varint(p[Column::Flags], col[Column::Flags + 1], v))) {
+            return false;
+        }
+        batch.flags[e] = (uint32_t)v;
+        if (!(p[Column::Hits] = get_varint(p[Column::Hits], col[Column::Hits + 1], v)) || first + v > nhits) {
+            return false;
+        }
+        batch.first_hit[e] = (uint32_t)first;
+        batch.hits[e] = (uint32_t)v;
+        first += v;
+        if (!(p[Column::Geo] = get_varint(p[Column::Geo], col[Column::Geo + 1], v))) {
+            return false;
+        }
+        batch.geo[e] = (uint8_t)v;
+    }
+    if (first != nhits || hdr.bytes[Column::ChannelEdge] < (nhits * CHANNEL_EDGE_BITS + 7) / 8) {
+        return false;
+    }
+
+    const uint8_t* packed = col[Column::ChannelEdge];
+    uint64_t acc = 0;
+    int nbits = 0;
+    for (size_t i = 0; i < nhits; i++) {
+        while (nbits < CHANNEL_EDGE_BITS) {
+            acc |= (uint64_t)*packed++ << nbits;
+            nbits += 8;
+        }
+        batch.channel[i] = (uint8_t)(acc & DataWord::ChannelMask);
+        batch.edge[i] = (uint8_t)((acc >> 5) & 1);
+        acc >>= CHANNEL_EDGE_BITS;
+        nbits -= CHANNEL_EDGE_BITS;
+    }
+
+    const bool widths = hdr.bytes[Column::Width] != 0;
+    for (size_t e = 0; e < nevents; e++) {
+        int64_t t = 0;
+        const uint64_t t0 = batch.trigger_time[e] * hdr.time_scale;
+        const size_t end = batch.first_hit[e] + batch.hits[e];
+        for (size_t i = batch.first_hit[e]; i < end; i++) {
+            if (!(p[Column::Time] = get_varint(p[Column::Time], col[Column::Time + 1], v))) {
+                return false;
+            }
+            t += unzigzag(v);
+            batch.time[i] = (uint32_t)t;
+            batch.event[i] = batch.event_count[e];
+            batch.timestamp[i] = t0 + (int64_t)(int32_t)batch.time[i];
+            batch.width[i] = 0;
+            if (widths) {
+                if (!(p[Column::Width] = get_varint(p[Column::Width], col[Column::Width + 1], v))) {
+                    return false;
+                }
+                batch.width[i] = (uint32_t)v;
+            }
+        }
+    }
+
+    batch.nhits = nhits;
+    batch.nevents = nevents;
+    batch.open = false;
+    batch.time_scale = hdr.time_scale;
+    return true;
+}
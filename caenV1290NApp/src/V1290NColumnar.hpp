@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "V1290N.hpp"
+#include "V1290NDecoder.hpp"
+
+// Block payload layout of FileFormat::Columnar: one ColumnarHeader, then the columns in Column
+// order, each ColumnarHeader::bytes[c] long. The payload is zero padded to whole 32-bit words.
+#define COLUMNAR_MAGIC 0x434F4C32u // "COL2"
+#define COLUMNAR_MAGIC_V1 0x434F4C31u // "COL1", no time_scale, timestamps at 25 ps
+
+namespace Column {
+// Per event. Counters are zigzag varints of the difference to the previous event, starting from
+// the header's first_event/first_trigger_time; the rest are plain varints.
+static const int EventCount = 0;
+static const int TriggerTime = 1;
+static const int Flags = 2;
+static const int Hits = 3;
+static const int Geo = 4;
+// Per hit. ChannelEdge packs channel | edge << 5 into 6 bits, LSB first. Time is a zigzag varint
+// of the difference to the previous hit of the same event, the first hit's to 0. Width is a
+// varint per hit, or empty if no hit in the block has a time over threshold.
+static const int ChannelEdge = 5;
+static const int Time = 6;
+static const int Width = 7;
+static const int Count = 8;
+} // namespace Column
+
+/// \brief Start of every columnar block, also what the segment index is keyed on.
+struct ColumnarHeader {
+    uint32_t magic;
+    uint32_t nevents;
+    uint32_t nhits;
+    uint32_t bytes[Column::Count]; // Encoded size of each column
+    uint32_t time_scale;           // HitBatch::time_scale of the encoded events
+    uint64_t first_event;          // Event count of the first and last event
+    uint64_t last_event;
+    uint64_t first_trigger_time;   // Trigger time tag of the first and last event
+    uint64_t last_trigger_time;
+};
+
+/// \brief Largest payload columnar_encode() can produce for a batch of this size.
+size_t columnar_max_bytes(size_t nevents, size_t nhits);
+
+/// \brief Encodes the complete events of batch as one columnar block payload.
+///
+/// Lossless for everything a HitBatch holds: event[] and timestamp[] are implied by the event
+/// columns. The raw format spends a full 32-bit word per hit; here a hit takes 6 bits of
+/// channel and edge plus typically one or two bytes of time delta.
+/// \param out Destination, at least columnar_max_bytes() long.
+/// \return Payload size in bytes, a multiple of 4.
+size_t columnar_encode(const HitBatch& batch, uint8_t* out);
+
+/// \brief Decodes one columnar block payload into batch, replacing its contents.
+/// \return False if the payload is malformed or doesn't fit a HitBatch.
+bool columnar_decode(const uint8_t* in, size_t bytes, HitBatch& batch);
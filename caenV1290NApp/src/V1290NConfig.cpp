@@ -0,0 +1,132 @@
+#include "V1290NConfig.hpp"
+
+// Commands appended by tdc_config_read()
+static const size_t READ_COMMANDS = 11 + MAX_CHANNELS;
+
+int tdc_config_validate(const TdcConfig& config) {
+    const uint16_t* w = config.words;
+    // Largest valid value of each word before ChannelAdjust, all minimums are 0 unless noted
+    static const uint16_t max[TdcConfigWord::ChannelAdjust] = {
+        1,      // AcquisitionMode
+        0xFFF,  // WindowWidth, at least 1
+        0xFFFF, // WindowOffset, checked below
+        0xFFF,  // SearchMargin
+        0xFFF,  // RejectMargin
+        1,      // TriggerSubtraction
+        3,      // EdgeDetectMode
+        0xFFFF, // Resolution, checked below
+        3,      // DeadTime
+        1,      // HeaderTrailer
+        9,      // EventSize
+        1,      // ErrorMark
+        1,      // ErrorBypass
+        0x7FF,  // ErrorTypes
+        7,      // FifoSize
+        0xFFFF, // EnablePattern
+        0xFFF,  // GlobalOffsetCoarse
+        0x1F,   // GlobalOffsetFine
+    };
+    for (int i = 0; i < TdcConfigWord::ChannelAdjust; i++) {
+        if (w[i] > max[i]) {
+            return i;
+        }
+    }
+    if (w[TdcConfigWord::WindowWidth] < 1) {
+        return TdcConfigWord::WindowWidth;
+    }
+    // 12-bit two's complement, -2048..+40 clock cycles
+    const uint16_t offset = w[TdcConfigWord::WindowOffset];
+    if (offset > 40 && offset < 0xF800) {
+        return TdcConfigWord::WindowOffset;
+    }
+    // Pair mode takes the SetPairResolution word (edge LSB in bits 2..0, width LSB in bits 11..8)
+    const uint16_t res = w[TdcConfigWord::Resolution];
+    if (w[TdcConfigWord::EdgeDetectMode] == 0 ? (res & ~0x0F07) != 0 : res > 3) {
+        return TdcConfigWord::Resolution;
+    }
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        if (w[TdcConfigWord::ChannelAdjust + ch] > 0xFF) {
+            return TdcConfigWord::ChannelAdjust + ch;
+        }
+    }
+    return -1;
+}
+
+bool tdc_config_write(const TdcConfig& config, MicroBatch& batch) {
+    const uint16_t* w = config.words;
+    const uint16_t offset[2] = {w[TdcConfigWord::GlobalOffsetCoarse], w[TdcConfigWord::GlobalOffsetFine]};
+
+    // The trigger settings only take effect in trigger matching mode, so select the mode first
+    bool ok = batch.write(w[TdcConfigWord::AcquisitionMode] ? Opcode::SetTriggerMatch : Opcode::SetContinuous) &&
+              batch.write(Opcode::SetWindowWidth, w[TdcConfigWord::WindowWidth]) &&
+              batch.write(Opcode::SetWindowOffset, w[TdcConfigWord::WindowOffset]) &&
+              batch.write(Opcode::SetSearchMargin, w[TdcConfigWord::SearchMargin]) &&
+              batch.write(Opcode::SetRejectMargin, w[TdcConfigWord::RejectMargin]) &&
+              batch.write(w[TdcConfigWord::TriggerSubtraction] ? Opcode::EnableTriggerSubtraction
+                                                               : Opcode::DisableTriggerSubtraction) &&
+              batch.write(Opcode::SetEdgeDetectionMode, w[TdcConfigWord::EdgeDetectMode]) &&
+              batch.write(w[TdcConfigWord::EdgeDetectMode] == 0 ? Opcode::SetPairResolution : Opcode::SetEdgeResolution,
+                          w[TdcConfigWord::Resolution]) &&
+              batch.write(Opcode::SetDeadTime, w[TdcConfigWord::DeadTime]) &&
+              batch.write(w[TdcConfigWord::HeaderTrailer] ? Opcode::EnableTDCHeaderTrailer
+                                                          : Opcode::DisableTDCHeaderTrailer) &&
+              batch.write(Opcode::SetEventSize, w[TdcConfigWord::EventSize]) &&
+              batch.write(w[TdcConfigWord::ErrorMark] ? Opcode::EnableErrorMark : Opcode::DisableErrorMark) &&
+              batch.write(w[TdcConfigWord::ErrorBypass] ? Opcode::EnableErrorBypass : Opcode::DisableErrorBypass) &&
+              batch.write(Opcode::SetErrorTypes, w[TdcConfigWord::ErrorTypes]) &&
+              batch.write(Opcode::SetFifoSize, w[TdcConfigWord::FifoSize]) &&
+              batch.write(Opcode::WriteEnablePattern, w[TdcConfigWord::EnablePattern]) &&
+              batch.write(Opcode::SetGlobalOffset, offset, 2);
+    for (int ch = 0; ok && ch < MAX_CHANNELS; ch++) {
+        ok = batch.write(Opcode::SetChannelAdjust | ch, w[TdcConfigWord::ChannelAdjust + ch]);
+    }
+    return ok;
+}
+
+bool tdc_config_read(MicroBatch& batch) {
+    bool ok = batch.read(Opcode::ReadAcquisitionMode) && batch.read(Opcode::ReadTriggerConfig, 5) &&
+              batch.read(Opcode::ReadEdgeDetectionMode) && batch.read(Opcode::ReadResolution) &&
+              batch.read(Opcode::ReadDeadTime) && batch.read(Opcode::TDCHeaderTrailerStatus) &&
+              batch.read(Opcode::ReadEventSize) && batch.read(Opcode::ReadErrorTypes) &&
+              batch.read(Opcode::ReadFifoSize) && batch.read(Opcode::ReadEnablePattern) &&
+              batch.read(Opcode::ReadGlobalOffset, 2);
+    for (int ch = 0; ok && ch < MAX_CHANNELS; ch++) {
+        ok = batch.read(Opcode::ReadChannelAdjust | ch);
+    }
+    return ok;
+}
+
+bool tdc_config_parse(const MicroBatch& batch, size_t first, TdcConfig& config) {
+    if (batch.completed < first + READ_COMMANDS) {
+        return false;
+    }
+    uint16_t* w = config.words;
+    size_t i = first;
+    w[TdcConfigWord::AcquisitionMode] = batch.command(i++).data[0] & 0x1;
+
+    const uint16_t* trg = batch.command(i++).data;
+    w[TdcConfigWord::WindowWidth] = trg[0] & 0xFFF;
+    // Sign extend the 12-bit offset so it reads back the way it was written
+    w[TdcConfigWord::WindowOffset] = (trg[1] & 0x800) ? (trg[1] | 0xF000) : (trg[1] & 0xFFF);
+    w[TdcConfigWord::SearchMargin] = trg[2] & 0xFFF;
+    w[TdcConfigWord::RejectMargin] = trg[3] & 0xFFF;
+    w[TdcConfigWord::TriggerSubtraction] = trg[4] & 0x1;
+
+    w[TdcConfigWord::EdgeDetectMode] = batch.command(i++).data[0] & 0x3;
+    w[TdcConfigWord::Resolution] = batch.command(i++).data[0];
+    w[TdcConfigWord::DeadTime] = batch.command(i++).data[0] & 0x3;
+    w[TdcConfigWord::HeaderTrailer] = batch.command(i++).data[0] & 0x1;
+    w[TdcConfigWord::EventSize] = batch.command(i++).data[0] & 0xF;
+    w[TdcConfigWord::ErrorTypes] = batch.command(i++).data[0] & 0x7FF;
+    w[TdcConfigWord::FifoSize] = batch.command(i++).data[0] & 0x7;
+    w[TdcConfigWord::EnablePattern] = batch.command(i++).data[0];
+
+    const uint16_t* offset = batch.command(i++).data;
+    w[TdcConfigWord::GlobalOffsetCoarse] = offset[0] & 0xFFF;
+    w[TdcConfigWord::GlobalOffsetFine] = offset[1] & 0x1F;
+
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        w[TdcConfigWord::ChannelAdjust + ch] = batch.command(i++).data[0] & 0xFF;
+    }
+    return true;
+}
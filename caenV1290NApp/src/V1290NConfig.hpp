@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "V1290N.hpp"
+#include "V1290NMicro.hpp"
+
+// Positions of the settings in a TdcConfig, also the layout of the CONFIG asyn array
+namespace TdcConfigWord {
+static const int AcquisitionMode = 0;    // 0=continuous, 1=trigger matching
+static const int WindowWidth = 1;        // 25 ns units
+static const int WindowOffset = 2;       // 25 ns units, 12-bit two's complement
+static const int SearchMargin = 3;       // extra search window, 25 ns units
+static const int RejectMargin = 4;       // 25 ns units
+static const int TriggerSubtraction = 5; // 0/1
+static const int EdgeDetectMode = 6;     // 0=pair, 1=trailing, 2=leading, 3=both
+static const int Resolution = 7;         // SetEdgeResolution code, 3=25 ps on the V1290
+static const int DeadTime = 8;           // 0..3 = 5, 10, 30, 100 ns
+static const int HeaderTrailer = 9;      // 0/1
+static const int EventSize = 10;         // max hits per event code, 9 = no limit
+static const int ErrorMark = 11;         // 0/1, write only
+static const int ErrorBypass = 12;       // 0/1, write only
+static const int ErrorTypes = 13;        // 11-bit mask
+static const int FifoSize = 14;          // 0..7 = 2..256 words
+static const int EnablePattern = 15;     // one bit per channel
+static const int GlobalOffsetCoarse = 16;
+static const int GlobalOffsetFine = 17;
+static const int ChannelAdjust = 18;     // first of MAX_CHANNELS words, 0..255
+static const int Count = ChannelAdjust + MAX_CHANNELS;
+} // namespace TdcConfigWord
+
+/// \brief Complete micro controller configuration of one board.
+struct TdcConfig {
+    uint16_t words[TdcConfigWord::Count];
+};
+
+/// \brief Checks every setting against its valid range.
+/// \return Index of the first invalid word, or -1 if the configuration is valid.
+int tdc_config_validate(const TdcConfig& config);
+
+/// \brief Appends the commands writing the whole configuration to a batch.
+/// \return True on success, false if the batch is full.
+bool tdc_config_write(const TdcConfig& config, MicroBatch& batch);
+
+/// \brief Appends the commands reading the whole configuration back to a batch.
+/// \return True on success, false if the batch is full.
+bool tdc_config_read(MicroBatch& batch);
+
+/// \brief Fills a configuration from a batch built by tdc_config_read() and executed.
+///
+/// ErrorMark and ErrorBypass have no read opcode and are left as they are in config.
+/// \param first Index of the first command tdc_config_read() appended.
+/// \return True on success, false if the batch didn't complete.
+bool tdc_config_parse(const MicroBatch& batch, size_t first, TdcConfig& config);
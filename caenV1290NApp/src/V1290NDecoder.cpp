@@ -0,0 +1,387 @@
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "V1290NDecoder.hpp"
+
+// Once fewer than this many hit slots are left the decoder returns at the next event boundary
+static const size_t HIT_BATCH_LOW_WATER = HIT_BATCH_CAPACITY / 8;
+
+/// \brief Extends a counter of width mask to 64 bits given its last extended value.
+///
+/// The masked difference is the forward distance travelled since last, wrap or not, so this
+/// needs no compare or branch.
+static inline uint64_t unwrap(uint64_t last, uint32_t raw, uint32_t mask) {
+    return last + ((raw - (uint32_t)last) & mask);
+}
+
+void HitBatch::compact() {
+    if (!open) {
+        nhits = 0;
+        nevents = 0;
+        return;
+    }
+
+    const size_t first = first_hit[nevents];
+    const size_t keep = nhits - first;
+    if (first > 0) {
+        memmove(channel, channel + first, keep * sizeof(channel[0]));
+        memmove(edge, edge + first, keep * sizeof(edge[0]));
+        memmove(time, time + first, keep * sizeof(time[0]));
+        memmove(event, event + first, keep * sizeof(event[0]));
+        memmove(timestamp, timestamp + first, keep * sizeof(timestamp[0]));
+        memmove(width, width + first, keep * sizeof(width[0]));
+    }
+
+    event_count[0] = event_count[nevents];
+    trigger_time[0] = trigger_time[nevents];
+    flags[0] = flags[nevents];
+    first_hit[0] = 0;
+    hits[0] = 0;
+    geo[0] = geo[nevents];
+    nhits = keep;
+    nevents = 0;
+}
+
+// Bits of a continuous mode hit time before it rolls over
+static const int HIT_TIME_BITS = 21;
+
+void HitBatch::take_open(const HitBatch& from) {
+    nhits = 0;
+    nevents = 0;
+    open = from.open;
+    time_scale = from.time_scale;
+    if (!open) {
+        return;
+    }
+
+    const size_t e = from.nevents;
+    const size_t first = from.first_hit[e];
+    const size_t keep = from.nhits - first;
+    memcpy(channel, from.channel + first, keep * sizeof(channel[0]));
+    memcpy(edge, from.edge + first, keep * sizeof(edge[0]));
+    memcpy(time, from.time + first, keep * sizeof(time[0]));
+    memcpy(event, from.event + first, keep * sizeof(event[0]));
+    memcpy(timestamp, from.timestamp + first, keep * sizeof(timestamp[0]));
+    memcpy(width, from.width + first, keep * sizeof(width[0]));
+
+    event_count[0] = from.event_count[e];
+    trigger_time[0] = from.trigger_time[e];
+    flags[0] = from.flags[e];
+    first_hit[0] = 0;
+    hits[0] = 0;
+    geo[0] = from.geo[e];
+    nhits = keep;
+}
+
+Decoder::Decoder()
+    : event_count_(0), trigger_time_(0), time_scale_(DataWord::EtttLsbTdc), frame_scale_(DataWord::EtttLsbTdc),
+      frame_lsb_(0), unknown_(0), pairing_(false) {
+    reset();
+}
+
+uint32_t Decoder::time_scale(bool continuous, uint16_t edge_mode, uint16_t resolution, bool subtraction) {
+    static const uint32_t edge_lsb_per_tick[4] = {1000, 4000, 8000, 32000};
+    if (edge_mode == 0 || resolution > 3 || (!continuous && !subtraction)) {
+        return 0;
+    }
+    return edge_lsb_per_tick[resolution];
+}
+
+double Decoder::lsb_ns(uint16_t resolution) {
+    static const double edge_lsb_ns[4] = {0.8, 0.2, 0.1, 0.025};
+    return edge_lsb_ns[resolution & 0x3];
+}
+
+void Decoder::reset() {
+    event_count_ = 0;
+    trigger_time_ = 0;
+    frame_start_ = 0;
+    frame_end_ = 0;
+    // One rollover of headroom, so the signed unwrap of the first hit can't go below zero
+    hit_time_ = (uint64_t)1 << HIT_TIME_BITS;
+}
+
+void Decoder::set_frames(uint32_t frame_ticks) {
+    reset();
+    // Frames still need a duration in hit time LSBs when timestamps aren't valid
+    frame_scale_ = time_scale_ ? time_scale_ : DataWord::EtttLsbTdc;
+    frame_lsb_ = (uint64_t)frame_ticks * frame_scale_;
+}
+
+void Decoder::open_event(HitBatch& batch, uint64_t event_count, uint8_t geo, uint32_t flags) {
+    const size_t e = batch.nevents;
+    batch.event_count[e] = event_count;
+    batch.trigger_time[e] = 0;
+    batch.flags[e] = flags;
+    batch.first_hit[e] = batch.nhits;
+    batch.hits[e] = 0;
+    batch.geo[e] = geo;
+    batch.open = true;
+    event_count_ = event_count;
+}
+
+void Decoder::close_event(HitBatch& batch, size_t end) {
+    const size_t e = batch.nevents;
+    batch.hits[e] = end - batch.first_hit[e];
+
+    // The ETTT word comes after the hits, so absolute times can only be filled in now. Time is
+    // signed only for hits that arrived after their continuous mode frame was closed.
+    const uint64_t t0 = batch.trigger_time[e] * time_scale_;
+    if (!time_scale_) {
+        batch.flags[e] |= EventFlag::NoTimestamp;
+    }
+    const size_t first = batch.first_hit[e];
+    for (size_t i = first; i < end; i++) {
+        batch.timestamp[i] = t0 + (int64_t)(int32_t)batch.time[i];
+        batch.width[i] = 0;
+    }
+    if (pairing_) {
+        pair_edges(batch, first, end);
+    }
+    batch.nevents++;
+    batch.open = false;
+}
+
+void Decoder::pair_edges(HitBatch& batch, size_t first, size_t end) {
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        leading_[ch] = -1;
+    }
+    // Each channel's edges come from one TDC and are in time order, so one pass pairs them. A
+    // leading edge without a trailing one before the next leading edge stays unpaired.
+    for (size_t i = first; i < end; i++) {
+        const uint8_t ch = batch.channel[i];
+        if (ch >= MAX_CHANNELS) {
+            continue;
+        }
+        if (batch.edge[i] == Edge::Leading) {
+            leading_[ch] = (int32_t)i;
+        } else if (leading_[ch] >= 0) {
+            const size_t j = (size_t)leading_[ch];
+            if (batch.timestamp[i] > batch.timestamp[j]) {
+                batch.width[j] = (uint32_t)(batch.timestamp[i] - batch.timestamp[j]);
+            }
+            leading_[ch] = -1;
+        }
+    }
+}
+
+void Decoder::open_frame(HitBatch& batch, size_t first) {
+    const uint64_t frame = hit_time_ / frame_lsb_;
+    frame_start_ = frame * frame_lsb_;
+    frame_end_ = frame_start_ + frame_lsb_;
+    event_count_ = frame;
+
+    const size_t e = batch.nevents;
+    batch.event_count[e] = frame;
+    batch.trigger_time[e] = frame_start_ / frame_scale_;
+    batch.flags[e] = 0;
+    batch.first_hit[e] = first;
+    batch.hits[e] = 0;
+    batch.geo[e] = 0;
+    batch.open = true;
+}
+
+size_t Decoder::decode_frame(const uint32_t* words, size_t n, HitBatch& batch) {
+    // Only take what fits, every hit taken has to go through the unwrapping below
+    const size_t room = HIT_BATCH_CAPACITY - batch.nhits;
+    if (n > room) {
+        n = room;
+    }
+    const size_t first = batch.nhits;
+    if (!batch.open) {
+        open_frame(batch, first);
+    }
+    const size_t used = decode_measurements(words, n, batch);
+
+    for (size_t i = first; i < batch.nhits; i++) {
+        // Hits of different channels arrive slightly out of order, so the difference is signed
+        const int32_t delta = (int32_t)((batch.time[i] - (uint32_t)hit_time_) << (32 - HIT_TIME_BITS)) >>
+                              (32 - HIT_TIME_BITS);
+        hit_time_ += delta;
+        if (hit_time_ >= frame_end_) {
+            // Empty frames are skipped, the frame number says how many went by
+            if (i > batch.first_hit[batch.nevents]) {
+                if (batch.nevents >= EVENT_BATCH_CAPACITY) {
+                    // No slot left for the next frame, leave the rest for the next call
+                    hit_time_ -= delta;
+                    batch.nhits = i;
+                    return i - first;
+                }
+                close_event(batch, i);
+            }
+            open_frame(batch, i);
+        }
+        batch.time[i] = (uint32_t)(hit_time_ - frame_start_);
+        batch.event[i] = event_count_;
+    }
+
+    // A full batch ends the frame early, the next call reopens it from the last hit's time
+    if (batch.nhits == HIT_BATCH_CAPACITY && batch.nhits > batch.first_hit[batch.nevents]) {
+        batch.flags[batch.nevents] |= EventFlag::Split;
+        close_event(batch, batch.nhits);
+    }
+    return used;
+}
+
+size_t Decoder::decode_measurements(const uint32_t* words, size_t n, HitBatch& batch) {
+    const size_t room = HIT_BATCH_CAPACITY - batch.nhits;
+    const size_t limit = n < room ? n : room;
+    uint8_t* channel = batch.channel + batch.nhits;
+    uint8_t* edge = batch.edge + batch.nhits;
+    uint32_t* time = batch.time + batch.nhits;
+    uint64_t* event = batch.event + batch.nhits;
+    size_t k = 0;
+
+#if defined(__AVX2__)
+    {
+        const __m256i time_mask = _mm256_set1_epi32(DataWord::TimeMask);
+        const __m256i channel_mask = _mm256_set1_epi32(DataWord::ChannelMask);
+        const __m256i ev = _mm256_set1_epi64x((long long)event_count_);
+        for (; k + 8 <= limit; k += 8) {
+            const __m256i v = _mm256_loadu_si256((const __m256i*)(words + k));
+            const __m256i type = _mm256_srli_epi32(v, DataWord::TypeShift);
+            if (!_mm256_testz_si256(type, type)) {
+                break;
+            }
+            _mm256_storeu_si256((__m256i*)(time + k), _mm256_and_si256(v, time_mask));
+            _mm256_storeu_si256((__m256i*)(event + k), ev);
+            _mm256_storeu_si256((__m256i*)(event + k + 4), ev);
+
+            // Type bits are zero, so the edge is simply everything above bit 25
+            const __m256i ch = _mm256_and_si256(_mm256_srli_epi32(v, DataWord::ChannelShift), channel_mask);
+            const __m256i ed = _mm256_srli_epi32(v, DataWord::EdgeShift);
+            const __m128i ch16 = _mm_packs_epi32(_mm256_castsi256_si128(ch), _mm256_extracti128_si256(ch, 1));
+            const __m128i ed16 = _mm_packs_epi32(_mm256_castsi256_si128(ed), _mm256_extracti128_si256(ed, 1));
+            _mm_storel_epi64((__m128i*)(channel + k), _mm_packus_epi16(ch16, ch16));
+            _mm_storel_epi64((__m128i*)(edge + k), _mm_packus_epi16(ed16, ed16));
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i time_mask = _mm_set1_epi32(DataWord::TimeMask);
+        const __m128i channel_mask = _mm_set1_epi32(DataWord::ChannelMask);
+        const __m128i ev = _mm_set1_epi64x((long long)event_count_);
+        for (; k + 4 <= limit; k += 4) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(words + k));
+            const __m128i type = _mm_srli_epi32(v, DataWord::TypeShift);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(type, zero)) != 0xFFFF) {
+                break;
+            }
+            _mm_storeu_si128((__m128i*)(time + k), _mm_and_si128(v, time_mask));
+            _mm_storeu_si128((__m128i*)(event + k), ev);
+            _mm_storeu_si128((__m128i*)(event + k + 2), ev);
+
+            const __m128i ch = _mm_and_si128(_mm_srli_epi32(v, DataWord::ChannelShift), channel_mask);
+            const __m128i ed = _mm_srli_epi32(v, DataWord::EdgeShift);
+            const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(ch, ed), zero);
+            const int32_t ch8 = _mm_cvtsi128_si32(packed);
+            const int32_t ed8 = _mm_cvtsi128_si32(_mm_srli_si128(packed, 4));
+            memcpy(channel + k, &ch8, sizeof(ch8));
+            memcpy(edge + k, &ed8, sizeof(ed8));
+        }
+    }
+#endif
+
+    for (; k < limit; k++) {
+        const uint32_t w = words[k];
+        if (w >> DataWord::TypeShift) {
+            break;
+        }
+        channel[k] = (w >> DataWord::ChannelShift) & DataWord::ChannelMask;
+        edge[k] = (w >> DataWord::EdgeShift) & 1;
+        time[k] = w & DataWord::TimeMask;
+        event[k] = event_count_;
+    }
+    batch.nhits += k;
+
+    // Batch full: swallow the rest of the run so the decoder keeps making progress
+    if (k == room && k < n) {
+        size_t j = k;
+        while (j < n && (words[j] >> DataWord::TypeShift) == DataWord::Measurement) {
+            j++;
+        }
+        if (j > k) {
+            batch.flags[batch.nevents] |= EventFlag::Truncated;
+        }
+        return j;
+    }
+    return k;
+}
+
+size_t Decoder::decode(const uint32_t* words, size_t n, HitBatch& batch) {
+    batch.time_scale = time_scale_;
+    size_t i = 0;
+    while (i < n && batch.nevents < EVENT_BATCH_CAPACITY) {
+        const uint32_t w = words[i];
+        const uint32_t type = w >> DataWord::TypeShift;
+
+        if (type == DataWord::Measurement && frame_lsb_) {
+            i += decode_frame(words + i, n - i, batch);
+            if (batch.nevents > 0 && HIT_BATCH_CAPACITY - batch.nhits < HIT_BATCH_LOW_WATER) {
+                return i;
+            }
+            continue;
+        }
+        if (type == DataWord::Measurement) {
+            if (!batch.open) {
+                open_event(batch, event_count_, 0, EventFlag::MissingHeader);
+            }
+            i += decode_measurements(words + i, n - i, batch);
+            continue;
+        }
+        i++;
+
+        switch (type) {
+        case DataWord::GlobalHeader:
+            if (batch.open) {
+                batch.flags[batch.nevents] |= EventFlag::MissingTrailer;
+                close_event(batch, batch.nhits);
+                if (batch.nevents >= EVENT_BATCH_CAPACITY) {
+                    // No slot left for the new event, let the caller drain the batch first
+                    return i - 1;
+                }
+            }
+            open_event(batch,
+                       unwrap(event_count_, (w >> DataWord::EventCountShift) & DataWord::EventCountMask,
+                              DataWord::EventCountMask),
+                       w & DataWord::GeoMask, 0);
+            break;
+        case DataWord::TdcError:
+            if (!batch.open) {
+                open_event(batch, event_count_, 0, EventFlag::MissingHeader);
+            }
+            batch.flags[batch.nevents] |= w & DataWord::ErrorFlagsMask;
+            break;
+        case DataWord::Ettt:
+            trigger_time_ = unwrap(trigger_time_, w & DataWord::EtttMask, DataWord::EtttMask);
+            if (batch.open) {
+                batch.trigger_time[batch.nevents] = trigger_time_;
+            }
+            break;
+        case DataWord::GlobalTrailer:
+            if (!batch.open) {
+                open_event(batch, event_count_, w & DataWord::GeoMask, EventFlag::MissingHeader);
+            }
+            batch.flags[batch.nevents] |= ((w >> DataWord::StatusShift) & DataWord::StatusMask) << 16;
+            close_event(batch, batch.nhits);
+            if (HIT_BATCH_CAPACITY - batch.nhits < HIT_BATCH_LOW_WATER) {
+                return i;
+            }
+            break;
+        case DataWord::TdcHeader:
+        case DataWord::TdcTrailer:
+        case DataWord::Filler:
+            break;
+        default:
+            unknown_++;
+            break;
+        }
+    }
+    return i;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "V1290N.hpp"
+
+#define HIT_BATCH_CAPACITY 16384
+#define EVENT_BATCH_CAPACITY 2048
+
+/// \brief Decoded hits and events in structure-of-arrays form.
+///
+/// Hits of an event are stored contiguously starting at first_hit[e]. Events [0, nevents)
+/// are complete; if open is set, hits past the last complete event belong to an event whose
+/// global trailer hasn't been decoded yet and whose header fields live at index nevents.
+///
+/// Event counts and trigger time tags are unwrapped by the decoder, so they increase
+/// monotonically across rollovers and never need rollover handling downstream.
+///
+/// With edge pairing on, each leading edge followed by a trailing edge of the same channel
+/// within the event carries the pulse width in width; the trailing edge stays in the batch.
+struct HitBatch {
+    size_t nhits;
+    uint8_t channel[HIT_BATCH_CAPACITY];
+    uint8_t edge[HIT_BATCH_CAPACITY];
+    uint32_t time[HIT_BATCH_CAPACITY];
+    uint64_t event[HIT_BATCH_CAPACITY];     // Event count of the hit's event
+    uint64_t timestamp[HIT_BATCH_CAPACITY]; // trigger_time * time_scale + time, set when the event closes
+    uint32_t width[HIT_BATCH_CAPACITY];     // Time over threshold of a paired leading edge, else 0
+
+    size_t nevents;
+    bool open;
+    uint64_t event_count[EVENT_BATCH_CAPACITY + 1];  // Global header event count, unwrapped
+    uint64_t trigger_time[EVENT_BATCH_CAPACITY + 1]; // Extended trigger time tag, unwrapped, 0 if not enabled
+    uint32_t flags[EVENT_BATCH_CAPACITY + 1];        // EventFlag bits
+    uint32_t first_hit[EVENT_BATCH_CAPACITY + 1];
+    uint32_t hits[EVENT_BATCH_CAPACITY + 1];
+    uint8_t geo[EVENT_BATCH_CAPACITY + 1];
+
+    // Hit time LSBs per trigger time tag tick the timestamps were computed with, 0 if they hold
+    // the hit time alone (EventFlag::NoTimestamp)
+    uint32_t time_scale;
+
+    HitBatch() : nhits(0), nevents(0), open(false), time_scale(DataWord::EtttLsbTdc) {}
+
+    /// \brief Drops all events, complete or open.
+    void clear() {
+        nhits = 0;
+        nevents = 0;
+        open = false;
+    }
+
+    /// \brief Drops all complete events, keeping the open event (if any) at the front.
+    void compact();
+
+    /// \brief Empties this batch and moves in the open event (if any) of another, leaving that
+    /// one's complete events untouched.
+    void take_open(const HitBatch& from);
+};
+
+/// \brief Turns raw Output Buffer words into HitBatch columns.
+///
+/// Runs of measurement words, the bulk of every event, are classified and unpacked several at
+/// a time with SSE2 or AVX2 when the build targets x86; all other word types and non-x86
+/// targets go through the scalar state machine. Decoding state carries over between calls, so
+/// events may be split across ring reads.
+///
+/// The 22-bit event count and 27-bit trigger time tag are extended to 64 bits on the assumption
+/// that consecutive events are less than a full counter range apart (4M events, 107 s). A
+/// module clear resets the board counters, which shows up as one forward jump.
+///
+/// In continuous mode the board sends a bare stream of measurements whose 21-bit times roll
+/// over every 52 us. The decoder then unwraps the hit times itself and slices the stream into
+/// fixed-duration frames that are delivered as events: event_count is the frame number,
+/// trigger_time the frame start in trigger time tag units and time is relative to the frame
+/// start. A frame is complete once a hit past its end arrives. Unwrapping assumes the stream
+/// never goes quiet for a whole rollover, i.e. it is meant for high-rate free-running use.
+/// Pulses that straddle a frame boundary are not paired. A frame with more hits than a batch
+/// holds is split rather than truncated: each part but the last is flagged EventFlag::Split and
+/// the next event carries on with the same frame number, so no hit misses the time unwrapping.
+class Decoder {
+  public:
+    Decoder();
+
+    /// \brief Forgets any event in progress and restarts the unwrapped counters from 0.
+    void reset();
+
+    /// \brief Hit time LSBs per trigger time tag tick for the given board settings.
+    ///
+    /// Hit times count in the edge resolution LSB (code 0..3 = 800, 200, 100, 25 ps), the trigger
+    /// time tag in 800 ns. In trigger matching mode hit times are relative to the trigger only
+    /// with trigger time subtraction on; pair mode packs the width into the hit word.
+    /// \return The scale, 0 if hit times can't be placed on the trigger time tag axis.
+    static uint32_t time_scale(bool continuous, uint16_t edge_mode, uint16_t resolution, bool subtraction);
+
+    /// \brief Hit time LSB in ns for the edge resolution code, see time_scale().
+    static double lsb_ns(uint16_t resolution);
+
+    /// \brief Sets the scale timestamps are computed with, see time_scale().
+    ///
+    /// With 0, timestamp holds the hit time alone and events are flagged EventFlag::NoTimestamp.
+    /// Continuous mode frame durations are converted with the scale in set_frames(), so call
+    /// this first.
+    void set_time_scale(uint32_t lsb_per_tick) { time_scale_ = lsb_per_tick; }
+
+    /// \brief Selects continuous mode framing.
+    /// \param frame_ticks Frame duration in trigger time tag units (800 ns), 0 for trigger
+    /// matching events.
+    void set_frames(uint32_t frame_ticks);
+
+    /// \brief Enables pairing of leading and trailing edges into time over threshold.
+    ///
+    /// Meant for edge detection mode 3 (leading and trailing), in other modes there is
+    /// nothing to pair.
+    void set_pairing(bool on) { pairing_ = on; }
+
+    /// \brief Appends the hits and events in words to batch.
+    ///
+    /// Stops early, after a global trailer, once the batch is close to full.
+    /// \param words Raw data words.
+    /// \param n Number of words.
+    /// \param batch Batch to append to.
+    /// \return Number of words consumed.
+    size_t decode(const uint32_t* words, size_t n, HitBatch& batch);
+
+    size_t unknown_words() const { return unknown_; }
+
+  private:
+    void open_event(HitBatch& batch, uint64_t event_count, uint8_t geo, uint32_t flags);
+    void close_event(HitBatch& batch, size_t end);
+    void pair_edges(HitBatch& batch, size_t first, size_t end);
+    void open_frame(HitBatch& batch, size_t first);
+    size_t decode_measurements(const uint32_t* words, size_t n, HitBatch& batch);
+    size_t decode_frame(const uint32_t* words, size_t n, HitBatch& batch);
+
+    uint64_t event_count_;  // Last event count, unwrapped
+    uint64_t trigger_time_; // Last trigger time tag, unwrapped
+    uint32_t time_scale_;
+
+    // Continuous mode, frame_lsb_ == 0 in trigger matching mode. All in TDC LSBs, frame_scale_
+    // per trigger time tag tick.
+    uint32_t frame_scale_;
+    uint64_t frame_lsb_;
+    uint64_t frame_start_;
+    uint64_t frame_end_;
+    uint64_t hit_time_;     // Last hit time, unwrapped
+    size_t unknown_;
+
+    bool pairing_;
+    int32_t leading_[MAX_CHANNELS]; // Unpaired leading edge of each channel, -1 if none
+};
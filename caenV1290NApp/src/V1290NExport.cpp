@@ -0,0 +1,49 @@
+#include <epicsAtomic.h>
+
+#include "V1290NExport.hpp"
+
+void SharedBatch::reserve() { epicsAtomicIncrIntT(&refs_); }
+
+void SharedBatch::release() {
+    if (epicsAtomicDecrIntT(&refs_) == 0) {
+        pool_->put(this);
+    }
+}
+
+BatchPool::BatchPool() : batches_(new SharedBatch[EXPORT_POOL_SIZE]), nfree_(0), lock_(epicsMutexMustCreate()) {
+    for (size_t i = 0; i < EXPORT_POOL_SIZE; i++) {
+        batches_[i].pool_ = this;
+        free_[nfree_++] = &batches_[i];
+    }
+}
+
+BatchPool::~BatchPool() {
+    epicsMutexDestroy(lock_);
+    delete[] batches_;
+}
+
+SharedBatch* BatchPool::acquire() {
+    SharedBatch* batch = NULL;
+    epicsMutexLock(lock_);
+    if (nfree_ > 0) {
+        batch = free_[--nfree_];
+    }
+    epicsMutexUnlock(lock_);
+    if (batch) {
+        epicsAtomicSetIntT(&batch->refs_, 1);
+    }
+    return batch;
+}
+
+size_t BatchPool::in_use() const {
+    epicsMutexLock(lock_);
+    const size_t n = EXPORT_POOL_SIZE - nfree_;
+    epicsMutexUnlock(lock_);
+    return n;
+}
+
+void BatchPool::put(SharedBatch* batch) {
+    epicsMutexLock(lock_);
+    free_[nfree_++] = batch;
+    epicsMutexUnlock(lock_);
+}
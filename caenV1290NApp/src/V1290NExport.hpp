@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#include "V1290NDecoder.hpp"
+
+// Batches that can be decoding or held by subscribers at once
+#define EXPORT_POOL_SIZE 8
+
+class BatchPool;
+
+/// \brief A decoded batch shared read-only with every subscriber of the EXPORT param.
+///
+/// The driver decodes straight into pooled batches and hands the same object to all
+/// asynGenericPointer subscribers, so nothing is copied per subscriber. The pointer is only
+/// valid during the callback; a subscriber that wants the data longer calls reserve() in the
+/// callback and release() when done. Only the complete events [0, batch.nevents) are valid.
+class SharedBatch {
+  public:
+    HitBatch batch;
+    uint64_t sequence;    // Incremented for every exported batch, gaps mean dropped batches
+    epicsTimeStamp stamp; // When the batch was exported
+
+    void reserve();
+    void release();
+
+  private:
+    friend class BatchPool;
+    SharedBatch() : sequence(0), refs_(0), pool_(NULL) {}
+
+    int refs_;
+    BatchPool* pool_;
+};
+
+/// \brief Fixed set of SharedBatch buffers, allocated once.
+class BatchPool {
+  public:
+    BatchPool();
+    ~BatchPool();
+
+    /// \brief Borrows a free batch with one reference held by the caller.
+    /// \return The batch, or NULL if every batch is still referenced.
+    SharedBatch* acquire();
+
+    /// \brief Batches currently borrowed.
+    size_t in_use() const;
+
+  private:
+    friend class SharedBatch;
+    BatchPool(const BatchPool&);
+    BatchPool& operator=(const BatchPool&);
+
+    void put(SharedBatch* batch);
+
+    SharedBatch* batches_;
+    SharedBatch* free_[EXPORT_POOL_SIZE];
+    size_t nfree_;
+    epicsMutexId lock_;
+};
@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define V1290N_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "V1290NColumnar.hpp"
+#include "V1290NFileWriter.hpp"
+
+// Smallest segment accepted, so a segment always holds a useful amount of data
+static const size_t MIN_SEGMENT_BYTES = 0x10000;
+
+// stdio buffer for the fallback backend
+static const size_t STDIO_BUFFER_BYTES = 0x100000;
+
+#ifdef V1290N_USE_MMAP
+// Allocates disk blocks for the first bytes of the file; ftruncate() alone leaves it sparse
+static bool reserve_blocks(int fd, size_t bytes) {
+#if defined(__APPLE__)
+    fstore_t store = {F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)bytes, 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+        // No contiguous run left, take any free blocks
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+            return false;
+        }
+    }
+    return true;
+#else
+    return posix_fallocate(fd, 0, bytes) == 0;
+#endif
+}
+#endif
+
+FileWriter::FileWriter()
+    : segmentBytes_(0), format_(FileFormat::Raw), settings_(), segment_(0), open_(false), used_(0), total_(0),
+      encoded_(NULL), index_(NULL), nindex_(0), fd_(-1), map_(NULL), fp_(NULL), buf_(NULL) {
+    path_[0] = '\0';
+}
+
+FileWriter::~FileWriter() {
+    close();
+    free(buf_);
+    free(encoded_);
+    free(index_);
+}
+
+bool FileWriter::open(const char* path, size_t segment_bytes, uint32_t format, const RecordedSettings& settings) {
+    close();
+    if (!path || !path[0] || strlen(path) >= FILE_PATH_MAX - 16) {
+        printf("FileWriter: invalid path\n");
+        return false;
+    }
+    strcpy(path_, path);
+    segmentBytes_ = segment_bytes < MIN_SEGMENT_BYTES ? MIN_SEGMENT_BYTES : segment_bytes;
+    format_ = format;
+    settings_ = settings;
+    segment_ = 0;
+    total_ = 0;
+    if (format_ == FileFormat::Columnar) {
+        // A segment must hold at least one block of a full batch and its index entry
+        const size_t max_block = columnar_max_bytes(EVENT_BATCH_CAPACITY, HIT_BATCH_CAPACITY);
+        const size_t min_bytes =
+            sizeof(SegmentHeader) + sizeof(BlockHeader) + max_block + sizeof(IndexEntry) + sizeof(IndexFooter);
+        segmentBytes_ = segmentBytes_ < min_bytes ? min_bytes : segmentBytes_;
+        if (!encoded_) {
+            encoded_ = (uint8_t*)malloc(max_block);
+        }
+        if (!index_) {
+            index_ = (IndexEntry*)malloc(FILE_INDEX_MAX * sizeof(IndexEntry));
+        }
+        if (!encoded_ || !index_) {
+            printf("FileWriter: cannot allocate columnar buffers\n");
+            return false;
+        }
+    }
+    if (!open_segment()) {
+        return false;
+    }
+    open_ = true;
+    return true;
+}
+
+void FileWriter::close() {
+    if (open_) {
+        close_segment();
+        open_ = false;
+    }
+}
+
+bool FileWriter::open_segment() {
+    char name[FILE_PATH_MAX];
+    sprintf(name, "%s_%04d.v1290", path_, segment_);
+    used_ = 0;
+    nindex_ = 0;
+
+#ifdef V1290N_USE_MMAP
+    fd_ = ::open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        printf("FileWriter: cannot create %s\n", name);
+        return false;
+    }
+    // Reserve the blocks up front: a store into a mapped page with no disk block behind it
+    // raises SIGBUS when the disk is full, so never map a sparse segment
+    if (!reserve_blocks(fd_, segmentBytes_) || ftruncate(fd_, segmentBytes_) != 0) {
+        printf("FileWriter: cannot reserve %lu bytes for %s\n", (unsigned long)segmentBytes_, name);
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    void* p = mmap(NULL, segmentBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        printf("FileWriter: cannot map %s\n", name);
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    map_ = (uint8_t*)p;
+#else
+    fp_ = fopen(name, "wb");
+    if (!fp_) {
+        printf("FileWriter: cannot create %s\n", name);
+        return false;
+    }
+    if (!buf_) {
+        buf_ = (char*)malloc(STDIO_BUFFER_BYTES);
+    }
+    if (buf_) {
+        setvbuf(fp_, buf_, _IOFBF, STDIO_BUFFER_BYTES);
+    }
+#endif
+
+    SegmentHeader hdr;
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    hdr.magic = SEGMENT_MAGIC;
+    hdr.version = SEGMENT_VERSION;
+    hdr.segment = segment_;
+    hdr.format = format_;
+    hdr.start_sec = now.secPastEpoch;
+    hdr.start_nsec = now.nsec;
+    hdr.settings = settings_;
+    return append(&hdr, sizeof(hdr));
+}
+
+void FileWriter::close_segment() {
+    write_index();
+#ifdef V1290N_USE_MMAP
+    if (map_) {
+        msync(map_, used_, MS_ASYNC);
+        munmap(map_, segmentBytes_);
+        map_ = NULL;
+    }
+    if (fd_ >= 0) {
+        if (ftruncate(fd_, used_) != 0) {
+            printf("FileWriter: cannot truncate segment %d\n", segment_);
+        }
+        ::close(fd_);
+        fd_ = -1;
+    }
+#else
+    if (fp_) {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+#endif
+}
+
+bool FileWriter::append(const void* data, size_t bytes) {
+#ifdef V1290N_USE_MMAP
+    memcpy(map_ + used_, data, bytes);
+#else
+    if (fwrite(data, 1, bytes, fp_) != bytes) {
+        printf("FileWriter: write to segment %d failed\n", segment_);
+        return false;
+    }
+#endif
+    used_ += bytes;
+    total_ += bytes;
+    return true;
+}
+
+void FileWriter::write_index() {
+#ifdef V1290N_USE_MMAP
+    const bool writable = map_ != NULL;
+#else
+    const bool writable = fp_ != NULL;
+#endif
+    if (format_ != FileFormat::Columnar || !writable) {
+        return;
+    }
+    // write_batch() always leaves room for the index
+    IndexFooter footer;
+    footer.magic = INDEX_MAGIC;
+    footer.nentries = (uint32_t)nindex_;
+    footer.offset = used_;
+    append(index_, nindex_ * sizeof(IndexEntry));
+    append(&footer, sizeof(footer));
+}
+
+bool FileWriter::roll_segment() {
+    close_segment();
+    segment_++;
+    if (!open_segment()) {
+        close_segment();
+        open_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool FileWriter::write_block(const uint32_t* words, size_t n, const epicsTimeStamp& ts) {
+    if (!open_) {
+        return false;
+    }
+
+    const size_t max_words = (segmentBytes_ - sizeof(SegmentHeader) - sizeof(BlockHeader)) / sizeof(uint32_t);
+    while (n > 0) {
+        if (used_ + sizeof(BlockHeader) + sizeof(uint32_t) > segmentBytes_ && !roll_segment()) {
+            return false;
+        }
+
+        size_t k = (segmentBytes_ - used_ - sizeof(BlockHeader)) / sizeof(uint32_t);
+        k = k < max_words ? k : max_words;
+        k = k < n ? k : n;
+
+        BlockHeader hdr;
+        hdr.magic = BLOCK_MAGIC;
+        hdr.nwords = (uint32_t)k;
+        hdr.sec = ts.secPastEpoch;
+        hdr.nsec = ts.nsec;
+        if (!append(&hdr, sizeof(hdr)) || !append(words, k * sizeof(uint32_t))) {
+            close();
+            return false;
+        }
+        words += k;
+        n -= k;
+    }
+    return true;
+}
+
+bool FileWriter::write_batch(const HitBatch& batch, const epicsTimeStamp& ts) {
+    if (!open_ || format_ != FileFormat::Columnar) {
+        return false;
+    }
+
+    const size_t bytes = columnar_encode(batch, encoded_);
+    const size_t reserve = (nindex_ + 1) * sizeof(IndexEntry) + sizeof(IndexFooter);
+    if ((nindex_ == FILE_INDEX_MAX || used_ + sizeof(BlockHeader) + bytes + reserve > segmentBytes_) &&
+        !roll_segment()) {
+        return false;
+    }
+
+    ColumnarHeader col;
+    memcpy(&col, encoded_, sizeof(col));
+    IndexEntry& entry = index_[nindex_++];
+    entry.offset = used_;
+    entry.first_event = col.first_event;
+    entry.first_trigger_time = col.first_trigger_time;
+
+    BlockHeader hdr;
+    hdr.magic = BLOCK_MAGIC;
+    hdr.nwords = (uint32_t)(bytes / sizeof(uint32_t));
+    hdr.sec = ts.secPastEpoch;
+    hdr.nsec = ts.nsec;
+    if (!append(&hdr, sizeof(hdr)) || !append(encoded_, bytes)) {
+        close();
+        return false;
+    }
+    return true;
+}
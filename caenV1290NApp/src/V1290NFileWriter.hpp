@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <epicsTime.h>
+
+#include "V1290NDecoder.hpp"
+
+#define FILE_PATH_MAX 256
+
+// Segment layout: one SegmentHeader, then any number of blocks, each a BlockHeader followed by
+// nwords words of payload in the segment's FileFormat. All fields are in the byte order of the
+// host that recorded them; a reader on the other byte order sees SEGMENT_MAGIC swapped.
+#define SEGMENT_MAGIC 0x56313239u // "V129"
+#define BLOCK_MAGIC 0x424C4F4Bu   // "BLOK"
+#define SEGMENT_VERSION 2
+
+// Version 1 headers end after start_nsec
+#define SEGMENT_HEADER_V1_BYTES 24
+
+/// \brief Board and decoder settings the data of a segment was taken with.
+struct RecordedSettings {
+    uint32_t acquisition_mode;    // 1 trigger matching, 0 continuous
+    uint32_t edge_mode;           // Edge detection mode
+    uint32_t resolution;          // Edge resolution code
+    uint32_t trigger_subtraction; // 0/1
+    uint32_t frame_ticks;         // Continuous mode frame duration in 800 ns ticks
+};
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t segment;
+    uint32_t format; // FileFormat, how the block payloads are encoded
+    uint32_t start_sec; // epicsTime seconds past the EPICS epoch
+    uint32_t start_nsec;
+    RecordedSettings settings; // Version 2 on
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t nwords;
+    uint32_t sec;  // epicsTime the block was written
+    uint32_t nsec;
+};
+
+namespace FileFormat {
+static const uint32_t Raw = 0;      // Raw Output Buffer words, as read from the board
+static const uint32_t Columnar = 1; // Decoded, filtered batches, see V1290NColumnar.hpp
+} // namespace FileFormat
+
+// Columnar segments end with an index of their blocks followed by an IndexFooter, so a reader
+// finds any event or trigger time by reading the last bytes of the file and bisecting. The
+// index is only written when the segment is closed; ColumnarReader rebuilds it from the block
+// headers of a segment that wasn't.
+#define INDEX_MAGIC 0x494E4458u // "INDX"
+
+// Blocks indexed per segment, a segment rolls over when its index is full
+#define FILE_INDEX_MAX 16384
+
+struct IndexEntry {
+    uint64_t offset;             // Byte offset of the block's BlockHeader
+    uint64_t first_event;        // ColumnarHeader::first_event of the block
+    uint64_t first_trigger_time; // ColumnarHeader::first_trigger_time of the block
+};
+
+struct IndexFooter {
+    uint32_t magic;
+    uint32_t nentries;
+    uint64_t offset; // Byte offset of the first IndexEntry
+};
+
+/// \brief Writes blocks of data words to rolling, preallocated segment files.
+///
+/// Segments are named <path>_NNNN.v1290 and preallocated to the segment size. Where POSIX
+/// mmap is available the segment is mapped and filled with memcpy, so writing never goes
+/// through stdio or allocates; elsewhere it falls back to stdio with a large, fixed buffer.
+/// Each segment is truncated to its used length when it is closed, after the block index of a
+/// columnar segment has been appended.
+class FileWriter {
+  public:
+    FileWriter();
+    ~FileWriter();
+
+    /// \brief Starts a new recording at segment 0.
+    /// \param path Path prefix of the segment files.
+    /// \param segment_bytes Size of each segment.
+    /// \param format FileFormat stored in the segment headers.
+    /// \param settings Settings stored in the segment headers.
+    /// \return True on success, false on error.
+    bool open(const char* path, size_t segment_bytes, uint32_t format, const RecordedSettings& settings);
+
+    /// \brief Finishes the current segment and stops recording.
+    void close();
+
+    /// \brief Appends one block, rolling over to a new segment when the current one is full.
+    /// \return True on success, false on error (the writer is closed).
+    bool write_block(const uint32_t* words, size_t n, const epicsTimeStamp& ts);
+
+    /// \brief Appends the complete events of batch as one columnar block and indexes it.
+    ///
+    /// Only valid when opened with FileFormat::Columnar.
+    /// \return True on success, false on error (the writer is closed).
+    bool write_batch(const HitBatch& batch, const epicsTimeStamp& ts);
+
+    bool is_open() const { return open_; }
+    uint32_t format() const { return format_; }
+    double bytes_written() const { return total_; }
+    int segment() const { return segment_; }
+
+  private:
+    bool open_segment();
+    void close_segment();
+    bool append(const void* data, size_t bytes);
+    bool roll_segment();
+    void write_index();
+
+    char path_[FILE_PATH_MAX];
+    size_t segmentBytes_;
+    uint32_t format_;
+    RecordedSettings settings_;
+    int segment_;
+    bool open_;
+    size_t used_;
+    double total_;
+
+    // Columnar encoding, allocated when first used
+    uint8_t* encoded_;
+    IndexEntry* index_;
+    size_t nindex_;
+
+    // mmap backend
+    int fd_;
+    uint8_t* map_;
+
+    // stdio backend
+    FILE* fp_;
+    char* buf_;
+};
@@ -0,0 +1,92 @@
+#include "V1290NFilter.hpp"
+
+HitFilter::HitFilter() : hitsDropped_(0), eventsDropped_(0) {
+    FilterConfig config;
+    config.channels = 0xFFFF;
+    config.edges = FilterEdge::Both;
+    config.time_window = false;
+    config.time_min = 0;
+    config.time_max = 0;
+    config.min_hits = 0;
+    config.max_hits = 0;
+    config.drop_empty = false;
+    configure(config);
+}
+
+void HitFilter::configure(const FilterConfig& config) {
+    config_ = config;
+    if (!config.time_window) {
+        config_.time_min = -0x7FFFFFFF - 1;
+        config_.time_max = 0x7FFFFFFF;
+    }
+    edgeMask_[Edge::Leading] = (config.edges & FilterEdge::Leading) ? config.channels : 0;
+    edgeMask_[Edge::Trailing] = (config.edges & FilterEdge::Trailing) ? config.channels : 0;
+    pass_all_ = config.channels == 0xFFFF && (config.edges & FilterEdge::Both) == FilterEdge::Both &&
+                !config.time_window && config.min_hits == 0 && config.max_hits == 0 && !config.drop_empty;
+}
+
+void HitFilter::apply(HitBatch& b) {
+    if (pass_all_) {
+        return;
+    }
+    const uint32_t min_hits = config_.drop_empty && config_.min_hits == 0 ? 1 : config_.min_hits;
+    const uint32_t max_hits = config_.max_hits ? config_.max_hits : 0xFFFFFFFFu;
+    // Hits of the complete events, the open event's follow
+    const size_t nhits = b.open ? b.first_hit[b.nevents] : b.nhits;
+
+    size_t out = 0;
+    size_t kept = 0;
+    for (size_t e = 0; e < b.nevents; e++) {
+        const size_t start = out;
+        const size_t first = b.first_hit[e];
+        const size_t last = first + b.hits[e];
+        for (size_t i = first; i < last; i++) {
+            // Written unconditionally and kept by advancing out, so the loop has no data-dependent branch
+            const int32_t t = (int32_t)b.time[i];
+            // Channels are below 32 and the masks 16 bits wide, so channels past MAX_CHANNELS fail too
+            const bool pass = ((edgeMask_[b.edge[i] & 1] >> b.channel[i]) & 1) && t >= config_.time_min &&
+                              t <= config_.time_max;
+            b.channel[out] = b.channel[i];
+            b.edge[out] = b.edge[i];
+            b.time[out] = b.time[i];
+            b.event[out] = b.event[i];
+            b.timestamp[out] = b.timestamp[i];
+            b.width[out] = b.width[i];
+            out += pass;
+        }
+
+        const size_t n = out - start;
+        if (n < min_hits || n > max_hits) {
+            out = start;
+            continue;
+        }
+        b.event_count[kept] = b.event_count[e];
+        b.trigger_time[kept] = b.trigger_time[e];
+        b.flags[kept] = b.flags[e];
+        b.first_hit[kept] = start;
+        b.hits[kept] = n;
+        b.geo[kept] = b.geo[e];
+        kept++;
+    }
+    hitsDropped_ += nhits - out;
+    eventsDropped_ += b.nevents - kept;
+
+    if (b.open) {
+        for (size_t i = nhits; i < b.nhits; i++) {
+            b.channel[out + i - nhits] = b.channel[i];
+            b.edge[out + i - nhits] = b.edge[i];
+            b.time[out + i - nhits] = b.time[i];
+            b.event[out + i - nhits] = b.event[i];
+            b.timestamp[out + i - nhits] = b.timestamp[i];
+            b.width[out + i - nhits] = b.width[i];
+        }
+        b.event_count[kept] = b.event_count[b.nevents];
+        b.trigger_time[kept] = b.trigger_time[b.nevents];
+        b.flags[kept] = b.flags[b.nevents];
+        b.first_hit[kept] = out;
+        b.hits[kept] = 0;
+        b.geo[kept] = b.geo[b.nevents];
+    }
+    b.nhits = out + (b.nhits - nhits);
+    b.nevents = kept;
+}
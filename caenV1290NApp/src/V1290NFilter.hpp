@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "V1290N.hpp"
+#include "V1290NDecoder.hpp"
+
+// Edge selection bits of FilterConfig::edges
+namespace FilterEdge {
+static const uint32_t Leading = (1 << 0);
+static const uint32_t Trailing = (1 << 1);
+static const uint32_t Both = Leading | Trailing;
+} // namespace FilterEdge
+
+/// \brief Software cuts applied to every decoded hit and event.
+struct FilterConfig {
+    uint16_t channels;  // Mask of accepted channels
+    uint32_t edges;     // FilterEdge bits of accepted edges
+    bool time_window;   // Apply time_min/time_max
+    int32_t time_min;   // Accepted hit times, in TDC LSBs relative to the trigger or frame
+    int32_t time_max;
+    uint32_t min_hits;  // Accepted hits per event after the hit cuts
+    uint32_t max_hits;  // 0 for no limit
+    bool drop_empty;    // Drop events without hits after the hit cuts
+};
+
+/// \brief Zero suppression and hit filtering between the decoder and every batch consumer.
+///
+/// Cuts are applied in place to the complete events of a batch: hits outside the channel mask,
+/// edge selection or time window are removed, then events outside the multiplicity limits,
+/// and with drop_empty also events left without hits, e.g. the header/trailer-only events the
+/// board sends with Control::EmptyEvent. Survivors are packed to the front in their original
+/// order and the open event, if any, is moved behind them untouched.
+///
+/// Time over threshold stays on the leading edge, so dropping trailing edges keeps the widths.
+/// Owned by the processing thread.
+class HitFilter {
+  public:
+    HitFilter();
+
+    void configure(const FilterConfig& config);
+    const FilterConfig& config() const { return config_; }
+
+    /// \brief True if the current cuts accept everything, apply() is then a no-op.
+    bool pass_all() const { return pass_all_; }
+
+    /// \brief Removes the rejected hits and events from the complete events of batch.
+    void apply(HitBatch& batch);
+
+    size_t hits_dropped() const { return hitsDropped_; }
+    size_t events_dropped() const { return eventsDropped_; }
+
+  private:
+    FilterConfig config_;
+    bool pass_all_;
+    uint16_t edgeMask_[2]; // Accepted channels for each edge
+    size_t hitsDropped_;
+    size_t eventsDropped_;
+};
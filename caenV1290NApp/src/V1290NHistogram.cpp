@@ -0,0 +1,45 @@
+#include <string.h>
+
+#include "V1290NHistogram.hpp"
+
+TimeHistograms::TimeHistograms() { configure(0, 16, 1024); }
+
+void TimeHistograms::configure(uint32_t min, uint32_t width, size_t nbins) {
+    min_ = min;
+    width_ = width ? width : 1;
+    nbins_ = nbins > MAX_HIST_BINS ? MAX_HIST_BINS : (nbins ? nbins : 1);
+    span_ = width_ * (uint32_t)nbins_;
+    clear();
+}
+
+void TimeHistograms::clear() { memset(counts_, 0, sizeof(counts_)); }
+
+void TimeHistograms::fill(const HitBatch& batch) {
+    if (batch.nevents == 0) {
+        return;
+    }
+    const size_t e = batch.nevents - 1;
+    const size_t nhits = batch.first_hit[e] + batch.hits[e];
+    for (size_t i = 0; i < nhits; i++) {
+        add(batch.channel[i], batch.edge[i], batch.time[i]);
+    }
+}
+
+void TimeHistograms::fill_widths(const HitBatch& batch) {
+    if (batch.nevents == 0) {
+        return;
+    }
+    const size_t e = batch.nevents - 1;
+    const size_t nhits = batch.first_hit[e] + batch.hits[e];
+    for (size_t i = 0; i < nhits; i++) {
+        if (batch.width[i]) {
+            add(batch.channel[i], Edge::Leading, batch.width[i]);
+        }
+    }
+}
+
+void TimeHistograms::axis(epicsFloat64* axis, double lsb_ns) const {
+    for (size_t i = 0; i < nbins_; i++) {
+        axis[i] = (min_ + (i + 0.5) * width_) * lsb_ns;
+    }
+}
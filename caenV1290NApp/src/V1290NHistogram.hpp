@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <epicsTypes.h>
+
+#include "V1290N.hpp"
+#include "V1290NDecoder.hpp"
+
+#define MAX_HIST_BINS 4096
+
+/// \brief Per-channel, per-edge histograms of TDC time.
+///
+/// Bins are counts of hits with min + i*width <= time < min + (i+1)*width, in TDC LSBs.
+/// Filled by the processing thread only; readers get a possibly-inconsistent snapshot, which
+/// is fine for display.
+class TimeHistograms {
+  public:
+    TimeHistograms();
+
+    /// \brief Changes the binning and clears all counts.
+    /// \param min Lower edge of the first bin in TDC LSBs.
+    /// \param width Bin width in TDC LSBs, at least 1.
+    /// \param nbins Number of bins, clamped to MAX_HIST_BINS.
+    void configure(uint32_t min, uint32_t width, size_t nbins);
+
+    void clear();
+
+    /// \brief Adds all hits of the complete events in batch.
+    void fill(const HitBatch& batch);
+
+    /// \brief Adds the time over threshold of all paired hits of the complete events in batch.
+    ///
+    /// Widths go to the leading edge histograms, the trailing ones stay empty.
+    void fill_widths(const HitBatch& batch);
+
+    /// \brief Adds one value to a channel/edge histogram, ignoring anything outside the range.
+    void add(uint8_t channel, uint8_t edge, uint32_t time) {
+        const uint32_t offset = time - min_;
+        if (channel < MAX_CHANNELS && time >= min_ && offset < span_) {
+            counts_[channel][edge & 1][offset / width_]++;
+        }
+    }
+
+    const epicsInt32* counts(int channel, int edge) const { return counts_[channel][edge]; }
+    size_t nbins() const { return nbins_; }
+
+    /// \brief Fills axis with the bin centres in ns.
+    /// \param lsb_ns Hit time LSB in ns, see Decoder::lsb_ns().
+    void axis(epicsFloat64* axis, double lsb_ns) const;
+
+  private:
+    uint32_t min_;
+    uint32_t width_;
+    uint32_t span_;
+    size_t nbins_;
+    epicsInt32 counts_[MAX_CHANNELS][2][MAX_HIST_BINS];
+};
@@ -0,0 +1,57 @@
+#include <string.h>
+
+#include "V1290NLatency.hpp"
+
+static size_t bucket_of(uint64_t ns) {
+    if (ns < 8) {
+        return (size_t)ns;
+    }
+    // Keep the top 4 bits: ns = m << s with m in 8..15
+    size_t s = 0;
+    while ((ns >> s) >= 16) {
+        s++;
+    }
+    return 8 * s + (size_t)(ns >> s);
+}
+
+double LatencyHistogram::upper_edge(size_t b) {
+    b++;
+    if (b < 8) {
+        return (double)b;
+    }
+    const size_t s = (b - 8) / 8;
+    const size_t m = 8 + (b - 8) % 8;
+    return (double)m * (double)((uint64_t)1 << s);
+}
+
+LatencyHistogram::LatencyHistogram() { clear(); }
+
+void LatencyHistogram::clear() {
+    memset(counts_, 0, sizeof(counts_));
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+}
+
+void LatencyHistogram::add(uint64_t ns) {
+    counts_[bucket_of(ns)]++;
+    count_++;
+    sum_ += ns;
+    max_ = ns > max_ ? ns : max_;
+}
+
+double LatencyHistogram::percentile(double p) const {
+    if (count_ == 0) {
+        return 0.0;
+    }
+    const double target = p * count_;
+    size_t seen = 0;
+    for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += counts_[b];
+        if (seen > 0 && seen >= target) {
+            const double upper = upper_edge(b);
+            return upper < (double)max_ ? upper : (double)max_;
+        }
+    }
+    return (double)max_;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-linear buckets: exact below 8 ns, then 8 buckets per octave (about 12% wide) up to 2^64 ns
+#define LATENCY_BUCKETS 496
+
+namespace Stage {
+static const int Readout = 0; // one block from the board into the ring
+static const int Decode = 1;  // one Decoder::decode() call
+static const int Process = 2; // filtering, process_batch() and export of one batch
+static const int Write = 3;   // one FileWriter::write_block() or write_batch() call
+static const int Drain = 4;   // Status AlmostFull set until the readout thread sees it clear
+static const int Count = 5;
+} // namespace Stage
+
+/// \brief Histogram of durations in nanoseconds with percentile lookup.
+///
+/// Nothing but the documentation assumes nanoseconds, so it also serves for other
+/// non-negative quantities with a wide range, e.g. block sizes in words.
+///
+/// Each histogram has a single writer (the thread running the stage), so add() uses plain
+/// stores; readers on other threads may see a sample or two in flight. clear() is not
+/// synchronized with add() either, a sample racing a clear may survive it.
+class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    void add(uint64_t ns);
+    void clear();
+
+    size_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? (double)sum_ / count_ : 0.0; }
+
+    /// \brief Duration below which the fraction p (0..1) of the samples fall, in ns.
+    ///
+    /// Returns the upper edge of the bucket holding that sample, 0 without samples.
+    double percentile(double p) const;
+
+    /// \brief Samples in bucket b, 0 <= b < LATENCY_BUCKETS.
+    size_t bucket(size_t b) const { return counts_[b]; }
+
+    /// \brief Upper edge of bucket b in ns.
+    static double upper_edge(size_t b);
+
+  private:
+    size_t counts_[LATENCY_BUCKETS];
+    size_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
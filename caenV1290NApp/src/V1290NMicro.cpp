@@ -0,0 +1,33 @@
+#include <string.h>
+
+#include "V1290NMicro.hpp"
+
+MicroBatch::MicroBatch() : completed(0), done(epicsEventMustCreate(epicsEventEmpty)), ncommands_(0) {}
+
+MicroBatch::~MicroBatch() { epicsEventDestroy(done); }
+
+bool MicroBatch::write(uint16_t opcode, const uint16_t* vals, size_t n) {
+    if (ncommands_ >= MICRO_MAX_COMMANDS || n > MICRO_MAX_WORDS) {
+        return false;
+    }
+    MicroCommand& cmd = commands_[ncommands_++];
+    cmd.opcode = opcode;
+    cmd.nwrite = (uint16_t)n;
+    cmd.nread = 0;
+    if (n) {
+        memcpy(cmd.data, vals, n * sizeof(uint16_t));
+    }
+    return true;
+}
+
+bool MicroBatch::read(uint16_t opcode, size_t n) {
+    if (ncommands_ >= MICRO_MAX_COMMANDS || n > MICRO_MAX_WORDS) {
+        return false;
+    }
+    MicroCommand& cmd = commands_[ncommands_++];
+    cmd.opcode = opcode;
+    cmd.nwrite = 0;
+    cmd.nread = (uint16_t)n;
+    memset(cmd.data, 0, sizeof(cmd.data));
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <epicsEvent.h>
+
+#define MICRO_MAX_COMMANDS 64
+#define MICRO_MAX_WORDS 8
+
+/// \brief One micro controller opcode with the data words written after it or read back.
+struct MicroCommand {
+    uint16_t opcode;
+    uint16_t nwrite; // data words written after the opcode
+    uint16_t nread;  // data words read back after the opcode
+    uint16_t data[MICRO_MAX_WORDS];
+};
+
+/// \brief A sequence of micro controller commands executed back to back as one unit.
+///
+/// Build the batch with write() and read(), hand it to the driver's micro thread and wait for
+/// done. Commands run in order and execution stops at the first failure, so the first
+/// completed commands took effect and the rest did not. Words read back are stored in the
+/// command's data.
+class MicroBatch {
+  public:
+    MicroBatch();
+    ~MicroBatch();
+
+    void clear() {
+        ncommands_ = 0;
+        completed = 0;
+    }
+
+    /// \brief Appends an opcode followed by n data words.
+    /// \return True on success, false if the batch is full or n is too large.
+    bool write(uint16_t opcode, const uint16_t* vals = NULL, size_t n = 0);
+
+    /// \brief Appends an opcode followed by one data word.
+    bool write(uint16_t opcode, uint16_t val) { return write(opcode, &val, 1); }
+
+    /// \brief Appends an opcode that returns n data words.
+    /// \return True on success, false if the batch is full or n is too large.
+    bool read(uint16_t opcode, size_t n = 1);
+
+    size_t size() const { return ncommands_; }
+    const MicroCommand& command(size_t i) const { return commands_[i]; }
+    MicroCommand& command(size_t i) { return commands_[i]; }
+    bool ok() const { return completed == ncommands_; }
+
+    // Set by the micro thread: number of leading commands that completed, then done is signalled
+    size_t completed;
+    epicsEventId done;
+
+  private:
+    MicroCommand commands_[MICRO_MAX_COMMANDS];
+    size_t ncommands_;
+};
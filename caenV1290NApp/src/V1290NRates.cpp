@@ -0,0 +1,39 @@
+#include <string.h>
+
+#include "V1290NRates.hpp"
+
+RateMeter::RateMeter() : window_(5.0), newest_(0), nsamples_(0) { memset(samples_, 0, sizeof(samples_)); }
+
+void RateMeter::set_window(double seconds) { window_ = seconds > 0 ? seconds : window_; }
+
+void RateMeter::sample(double t, const size_t* counts) {
+    newest_ = (newest_ + 1) % MAX_RATE_SAMPLES;
+    samples_[newest_].t = t;
+    memcpy(samples_[newest_].counts, counts, sizeof(samples_[newest_].counts));
+    if (nsamples_ < MAX_RATE_SAMPLES) {
+        nsamples_++;
+    }
+}
+
+double RateMeter::rate(int counter) const {
+    if (nsamples_ < 2) {
+        return 0.0;
+    }
+
+    // Walk back to the oldest sample still inside the window, keeping at least one interval
+    const Sample& newest = samples_[newest_];
+    size_t oldest = (newest_ + MAX_RATE_SAMPLES - 1) % MAX_RATE_SAMPLES;
+    for (size_t k = 2; k < nsamples_; k++) {
+        const size_t i = (newest_ + MAX_RATE_SAMPLES - k) % MAX_RATE_SAMPLES;
+        if (newest.t - samples_[i].t > window_) {
+            break;
+        }
+        oldest = i;
+    }
+
+    const double dt = newest.t - samples_[oldest].t;
+    if (dt <= 0) {
+        return 0.0;
+    }
+    return (double)(newest.counts[counter] - samples_[oldest].counts[counter]) / dt;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "V1290N.hpp"
+
+#define MAX_RATE_SAMPLES 64
+
+namespace RateCounter {
+// Counters 0..MAX_CHANNELS-1 are per-channel hits
+static const int Hits = MAX_CHANNELS;
+static const int Events = MAX_CHANNELS + 1;
+static const int Triggers = MAX_CHANNELS + 2;
+static const int Count = MAX_CHANNELS + 3;
+} // namespace RateCounter
+
+/// \brief Turns monotonically increasing counters into rates over a sliding time window.
+///
+/// Each sample() stores a snapshot of all counters; a rate is the difference between the
+/// newest snapshot and the oldest one still inside the window, divided by their time distance.
+class RateMeter {
+  public:
+    RateMeter();
+
+    /// \param seconds Length of the sliding window.
+    void set_window(double seconds);
+
+    /// \brief Records a snapshot of the counters.
+    /// \param t Sample time in seconds, increasing.
+    /// \param counts RateCounter::Count counter values.
+    void sample(double t, const size_t* counts);
+
+    /// \brief Rate of one counter in counts per second, 0 until two samples exist.
+    double rate(int counter) const;
+
+  private:
+    struct Sample {
+        double t;
+        size_t counts[RateCounter::Count];
+    };
+
+    double window_;
+    size_t newest_;
+    size_t nsamples_;
+    Sample samples_[MAX_RATE_SAMPLES];
+};
@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "V1290NColumnar.hpp"
+#include "V1290NReplay.hpp"
+
+static uint32_t swap32(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+// Reads a segment header, which is shorter before version 2, and leaves fp at the first block.
+// swapped is set if the segment was recorded with the other byte order; hdr is then swapped.
+static bool read_segment_header(FILE* fp, SegmentHeader& hdr, bool& swapped) {
+    memset(&hdr, 0, sizeof(hdr));
+    if (fread(&hdr, SEGMENT_HEADER_V1_BYTES, 1, fp) != 1) {
+        return false;
+    }
+    swapped = hdr.magic == swap32(SEGMENT_MAGIC);
+    if (!swapped && hdr.magic != SEGMENT_MAGIC) {
+        return false;
+    }
+    const uint32_t version = swapped ? swap32(hdr.version) : hdr.version;
+    if (version >= 2 && fread((uint8_t*)&hdr + SEGMENT_HEADER_V1_BYTES, sizeof(hdr) - SEGMENT_HEADER_V1_BYTES, 1,
+                              fp) != 1) {
+        return false;
+    }
+    if (swapped) {
+        // Every field is a 32-bit word
+        uint32_t* w = (uint32_t*)&hdr;
+        for (size_t i = 0; i < sizeof(hdr) / sizeof(uint32_t); i++) {
+            w[i] = swap32(w[i]);
+        }
+    }
+    return true;
+}
+
+SegmentReader::SegmentReader() : segment_(0), swapped_(false), fp_(NULL), buf_(NULL), capacity_(0) {
+    path_[0] = '\0';
+    memset(&header_, 0, sizeof(header_));
+}
+
+SegmentReader::~SegmentReader() {
+    close();
+    free(buf_);
+}
+
+bool SegmentReader::open(const char* path) {
+    close();
+    if (!path || !path[0] || strlen(path) >= FILE_PATH_MAX - 16) {
+        printf("SegmentReader: invalid path\n");
+        return false;
+    }
+    strcpy(path_, path);
+    return open_segment(0);
+}
+
+void SegmentReader::close() {
+    if (fp_) {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+}
+
+bool SegmentReader::open_segment(int segment) {
+    close();
+    char name[FILE_PATH_MAX];
+    sprintf(name, "%s_%04d.v1290", path_, segment);
+    segment_ = segment;
+    fp_ = fopen(name, "rb");
+    if (!fp_) {
+        return false;
+    }
+
+    if (!read_segment_header(fp_, header_, swapped_)) {
+        printf("SegmentReader: %s is not a V1290N segment\n", name);
+        close();
+        return false;
+    }
+    if (header_.format != FileFormat::Raw) {
+        printf("SegmentReader: %s is not a raw recording (format %u)\n", name, header_.format);
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool SegmentReader::next_block(const uint32_t*& words, size_t& n, epicsTimeStamp& ts) {
+    while (fp_) {
+        BlockHeader hdr;
+        if (fread(&hdr, sizeof(hdr), 1, fp_) != 1) {
+            // End of this segment, the recording goes on in the next one if it exists
+            open_segment(segment_ + 1);
+            continue;
+        }
+        if (swapped_) {
+            hdr.magic = swap32(hdr.magic);
+            hdr.nwords = swap32(hdr.nwords);
+            hdr.sec = swap32(hdr.sec);
+            hdr.nsec = swap32(hdr.nsec);
+        }
+        if (hdr.magic == 0) {
+            // A segment that was never closed is zero past its last block
+            open_segment(segment_ + 1);
+            continue;
+        }
+        if (hdr.magic != BLOCK_MAGIC) {
+            printf("SegmentReader: bad block in segment %d of %s\n", segment_, path_);
+            close();
+            return false;
+        }
+        if (hdr.nwords > capacity_) {
+            uint32_t* buf = (uint32_t*)realloc(buf_, hdr.nwords * sizeof(uint32_t));
+            if (!buf) {
+                printf("SegmentReader: cannot allocate a block of %u words\n", hdr.nwords);
+                close();
+                return false;
+            }
+            buf_ = buf;
+            capacity_ = hdr.nwords;
+        }
+        if (fread(buf_, sizeof(uint32_t), hdr.nwords, fp_) != hdr.nwords) {
+            printf("SegmentReader: segment %d of %s ends inside a block\n", segment_, path_);
+            close();
+            return false;
+        }
+        if (swapped_) {
+            for (size_t i = 0; i < hdr.nwords; i++) {
+                buf_[i] = swap32(buf_[i]);
+            }
+        }
+        words = buf_;
+        n = hdr.nwords;
+        ts.secPastEpoch = hdr.sec;
+        ts.nsec = hdr.nsec;
+        return true;
+    }
+    return false;
+}
+
+ColumnarReader::ColumnarReader()
+    : fp_(NULL), firstBlock_(0), index_(NULL), nindex_(0), capacity_(0), scanned_(false), buf_(NULL), bufBytes_(0) {}
+
+ColumnarReader::~ColumnarReader() {
+    close();
+    free(index_);
+    free(buf_);
+}
+
+bool ColumnarReader::open(const char* path, int segment, bool scan) {
+    close();
+    if (!path || !path[0] || strlen(path) >= FILE_PATH_MAX - 16) {
+        printf("ColumnarReader: invalid path\n");
+        return false;
+    }
+    char name[FILE_PATH_MAX];
+    sprintf(name, "%s_%04d.v1290", path, segment);
+    fp_ = fopen(name, "rb");
+    if (!fp_) {
+        return false;
+    }
+
+    SegmentHeader hdr;
+    bool swapped = false;
+    if (!read_segment_header(fp_, hdr, swapped)) {
+        printf("ColumnarReader: %s is not a V1290N segment\n", name);
+        close();
+        return false;
+    }
+    // Columnar payloads are byte streams around host order headers, there is no word to swap
+    if (swapped) {
+        printf("ColumnarReader: %s was recorded with the other byte order\n", name);
+        close();
+        return false;
+    }
+    if (hdr.format != FileFormat::Columnar) {
+        printf("ColumnarReader: %s is not a columnar recording (format %u)\n", name, hdr.format);
+        close();
+        return false;
+    }
+    firstBlock_ = ftell(fp_);
+    if (fseek(fp_, 0, SEEK_END) != 0) {
+        close();
+        return false;
+    }
+    const long size = ftell(fp_);
+    scanned_ = scan || !load_footer(size);
+    if (scanned_) {
+        scan_blocks(size);
+    }
+    return true;
+}
+
+void ColumnarReader::close() {
+    if (fp_) {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+    nindex_ = 0;
+    scanned_ = false;
+}
+
+bool ColumnarReader::reserve(size_t nentries) {
+    if (nentries <= capacity_) {
+        return true;
+    }
+    size_t capacity = capacity_ ? capacity_ : 256;
+    while (capacity < nentries) {
+        capacity *= 2;
+    }
+    IndexEntry* index = (IndexEntry*)realloc(index_, capacity * sizeof(IndexEntry));
+    if (!index) {
+        printf("ColumnarReader: cannot allocate an index of %lu blocks\n", (unsigned long)capacity);
+        return false;
+    }
+    index_ = index;
+    capacity_ = capacity;
+    return true;
+}
+
+bool ColumnarReader::load_footer(long size) {
+    IndexFooter footer;
+    if (size < firstBlock_ + (long)sizeof(footer) || fseek(fp_, size - sizeof(footer), SEEK_SET) != 0 ||
+        fread(&footer, sizeof(footer), 1, fp_) != 1 || footer.magic != INDEX_MAGIC) {
+        return false;
+    }
+    // The footer has to close off exactly the entries in front of it
+    if (footer.offset < (uint64_t)firstBlock_ ||
+        footer.offset + (uint64_t)footer.nentries * sizeof(IndexEntry) + sizeof(footer) != (uint64_t)size) {
+        return false;
+    }
+    if (!reserve(footer.nentries) || fseek(fp_, (long)footer.offset, SEEK_SET) != 0 ||
+        fread(index_, sizeof(IndexEntry), footer.nentries, fp_) != footer.nentries) {
+        return false;
+    }
+    nindex_ = footer.nentries;
+    return true;
+}
+
+void ColumnarReader::scan_blocks(long size) {
+    nindex_ = 0;
+    long offset = firstBlock_;
+    while (offset + (long)sizeof(BlockHeader) <= size) {
+        BlockHeader hdr;
+        ColumnarHeader col;
+        if (fseek(fp_, offset, SEEK_SET) != 0 || fread(&hdr, sizeof(hdr), 1, fp_) != 1) {
+            break;
+        }
+        // Past the last block either the index starts or, in a segment that was never closed,
+        // the zeroed preallocation
+        if (hdr.magic != BLOCK_MAGIC) {
+            break;
+        }
+        // A block cut short by the crash ends the scan too
+        const long end = offset + (long)sizeof(hdr) + (long)hdr.nwords * (long)sizeof(uint32_t);
+        if (end > size || hdr.nwords * sizeof(uint32_t) < sizeof(col) || fread(&col, sizeof(col), 1, fp_) != 1 ||
+            (col.magic != COLUMNAR_MAGIC && col.magic != COLUMNAR_MAGIC_V1) || !reserve(nindex_ + 1)) {
+            break;
+        }
+        IndexEntry& entry = index_[nindex_++];
+        entry.offset = (uint64_t)offset;
+        entry.first_event = col.first_event;
+        entry.first_trigger_time = col.first_trigger_time;
+        offset = end;
+    }
+}
+
+// Last entry whose key is not after value, -1 if there is none. Keys increase through a segment.
+static long bisect(const IndexEntry* index, size_t n, uint64_t IndexEntry::*key, uint64_t value) {
+    size_t lo = 0;
+    size_t hi = n;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (index[mid].*key <= value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (long)lo - 1;
+}
+
+long ColumnarReader::find_event(uint64_t event) const {
+    return bisect(index_, nindex_, &IndexEntry::first_event, event);
+}
+
+long ColumnarReader::find_trigger_time(uint64_t trigger_time) const {
+    return bisect(index_, nindex_, &IndexEntry::first_trigger_time, trigger_time);
+}
+
+bool ColumnarReader::read(size_t block, HitBatch& batch, epicsTimeStamp* ts) {
+    if (!fp_ || block >= nindex_) {
+        return false;
+    }
+    BlockHeader hdr;
+    if (fseek(fp_, (long)index_[block].offset, SEEK_SET) != 0 || fread(&hdr, sizeof(hdr), 1, fp_) != 1 ||
+        hdr.magic != BLOCK_MAGIC) {
+        printf("ColumnarReader: bad block %lu\n", (unsigned long)block);
+        return false;
+    }
+    const size_t bytes = hdr.nwords * sizeof(uint32_t);
+    if (bytes > bufBytes_) {
+        uint8_t* buf = (uint8_t*)realloc(buf_, bytes);
+        if (!buf) {
+            printf("ColumnarReader: cannot allocate a block of %u words\n", hdr.nwords);
+            return false;
+        }
+        buf_ = buf;
+        bufBytes_ = bytes;
+    }
+    if (fread(buf_, 1, bytes, fp_) != bytes || !columnar_decode(buf_, bytes, batch)) {
+        printf("ColumnarReader: block %lu is malformed\n", (unsigned long)block);
+        return false;
+    }
+    if (ts) {
+        ts->secPastEpoch = hdr.sec;
+        ts->nsec = hdr.nsec;
+    }
+    return true;
+}
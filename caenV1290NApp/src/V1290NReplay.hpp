@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <epicsTime.h>
+
+#include "V1290NDecoder.hpp"
+#include "V1290NFileWriter.hpp"
+
+/// \brief Reads back the blocks of a raw recording made by FileWriter, segment after segment.
+///
+/// Opens <path>_0000.v1290 and moves on to the next segment file whenever one ends, until a
+/// segment is missing. Only FileFormat::Raw segments are accepted, since replay feeds the words
+/// through the decoder again; columnar segments are already decoded, see ColumnarReader. Blocks
+/// are read into one buffer that grows to the largest block seen. Recordings made on a host of
+/// the other byte order are swapped while they are read. Used by the readout thread only.
+class SegmentReader {
+  public:
+    SegmentReader();
+    ~SegmentReader();
+
+    /// \brief Starts reading the recording with this path prefix from its first segment.
+    /// \return True if the first segment is a raw recording, false otherwise.
+    bool open(const char* path);
+
+    /// \brief Starts over from the first segment.
+    bool rewind() { return open_segment(0); }
+
+    void close();
+
+    /// \brief Reads the next block.
+    /// \param words Set to the block's words, valid until the next call.
+    /// \param n Set to the number of words.
+    /// \param ts Set to when the block was recorded.
+    /// \return False at the end of the recording or on a read error.
+    bool next_block(const uint32_t*& words, size_t& n, epicsTimeStamp& ts);
+
+    int segment() const { return segment_; }
+    const char* path() const { return path_; }
+
+    /// \brief Header of the current segment, in host byte order.
+    const SegmentHeader& header() const { return header_; }
+
+    /// \brief True if the current segment records the settings it was taken with (version 2 on).
+    bool has_settings() const { return header_.version >= 2; }
+
+  private:
+    SegmentReader(const SegmentReader&);
+    SegmentReader& operator=(const SegmentReader&);
+
+    bool open_segment(int segment);
+
+    char path_[FILE_PATH_MAX];
+    int segment_;
+    SegmentHeader header_;
+    bool swapped_; // Recorded on a host of the other byte order
+    FILE* fp_;
+    uint32_t* buf_;
+    size_t capacity_; // Words in buf_
+};
+
+/// \brief Random access to one columnar segment of a recording made by FileWriter.
+///
+/// The block index comes from the footer the writer appends when it closes a segment. A
+/// segment that was never closed, e.g. because the IOC died while recording, has no valid
+/// footer; its index is then rebuilt by walking the block headers from the start, which also
+/// recovers every block written before the crash.
+class ColumnarReader {
+  public:
+    ColumnarReader();
+    ~ColumnarReader();
+
+    /// \brief Opens segment <path>_NNNN.v1290 and loads its block index.
+    /// \param scan Ignore the footer and rebuild the index from the block headers.
+    /// \return True if the segment is a columnar recording, false otherwise.
+    bool open(const char* path, int segment, bool scan = false);
+
+    void close();
+
+    /// \brief Number of blocks in the segment.
+    size_t blocks() const { return nindex_; }
+
+    /// \brief Index entry of a block, in file order.
+    const IndexEntry& entry(size_t block) const { return index_[block]; }
+
+    /// \brief True if the index was rebuilt rather than read from the footer.
+    bool scanned() const { return scanned_; }
+
+    /// \brief Finds the block holding an event count.
+    ///
+    /// Bisects the index, so it relies on event counts increasing through the segment; they
+    /// start over when the decoder is reset, e.g. by a change of acquisition mode.
+    /// \return The last block whose first event is not after event, -1 if there is none.
+    long find_event(uint64_t event) const;
+
+    /// \brief Finds the block holding a trigger time tag, see find_event().
+    long find_trigger_time(uint64_t trigger_time) const;
+
+    /// \brief Reads and decodes one block.
+    /// \param ts Set to when the block was recorded, if not NULL.
+    /// \return False on a read error or a malformed block.
+    bool read(size_t block, HitBatch& batch, epicsTimeStamp* ts = NULL);
+
+  private:
+    ColumnarReader(const ColumnarReader&);
+    ColumnarReader& operator=(const ColumnarReader&);
+
+    bool load_footer(long size);
+    void scan_blocks(long size);
+    bool reserve(size_t nentries);
+
+    FILE* fp_;
+    long firstBlock_; // Byte offset of the first block
+    IndexEntry* index_;
+    size_t nindex_;
+    size_t capacity_; // Entries in index_
+    bool scanned_;
+    uint8_t* buf_;
+    size_t bufBytes_;
+};
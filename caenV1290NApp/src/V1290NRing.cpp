@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "V1290NRing.hpp"
+
+WordRing::WordRing(size_t min_words) {
+    size_t cap = RING_CACHE_LINE / sizeof(uint32_t);
+    while (cap < min_words) {
+        cap <<= 1;
+    }
+    mask_ = cap - 1;
+
+    // One allocation holds the head cursor, the reader cursors and the data, all aligned to
+    // a cache line. Preallocated here so the readout path never touches the allocator.
+    const size_t cursors = (1 + RING_MAX_READERS) * sizeof(Cursor);
+    alloc_ = malloc(cursors + cap * sizeof(uint32_t) + RING_CACHE_LINE);
+    uint8_t* p = (uint8_t*)alloc_;
+    p += (RING_CACHE_LINE - ((uintptr_t)p & (RING_CACHE_LINE - 1))) & (RING_CACHE_LINE - 1);
+    memset(p, 0, cursors);
+
+    head_ = (Cursor*)p;
+    readers_ = head_ + 1;
+    data_ = (uint32_t*)(p + cursors);
+}
+
+WordRing::~WordRing() { free(alloc_); }
+
+int WordRing::add_reader() {
+    for (int r = 0; r < RING_MAX_READERS; r++) {
+        if (epicsAtomicCmpAndSwapIntT(&readers_[r].active, 0, -1) == 0) {
+            // The reader is published before it takes its final position. A writer that missed
+            // it reserved at most capacity() words past a head no later than the one read after
+            // the (fully fenced) swap, so nothing from that position on can be overwritten. The
+            // first position only bounds the writer until then; reserve() stalls if it's stale.
+            epicsAtomicSetSizeT(&readers_[r].pos, epicsAtomicGetSizeT(&head_->pos));
+            epicsAtomicCmpAndSwapIntT(&readers_[r].active, -1, 1);
+            epicsAtomicSetSizeT(&readers_[r].pos, epicsAtomicGetSizeT(&head_->pos));
+            return r;
+        }
+    }
+    return -1;
+}
+
+void WordRing::remove_reader(int reader) {
+    if (reader >= 0 && reader < RING_MAX_READERS) {
+        epicsAtomicSetIntT(&readers_[reader].active, 0);
+    }
+}
+
+size_t WordRing::slowest_reader() const {
+    const size_t head = epicsAtomicGetSizeT(&head_->pos);
+    size_t tail = head;
+    for (int r = 0; r < RING_MAX_READERS; r++) {
+        if (epicsAtomicGetIntT(&readers_[r].active) == 1) {
+            const size_t pos = epicsAtomicGetSizeT(&readers_[r].pos);
+            if (head - pos > head - tail) {
+                tail = pos;
+            }
+        }
+    }
+    return tail;
+}
+
+uint32_t* WordRing::reserve(size_t& n) {
+    const size_t head = head_->pos;
+    const size_t held = head - slowest_reader();
+    // The reader positions must be loaded before we store into the words they released
+    epicsAtomicReadMemoryBarrier();
+    epicsAtomicWriteMemoryBarrier();
+    const size_t free_words = held < capacity() ? capacity() - held : 0;
+    const size_t to_wrap = capacity() - (head & mask_);
+    n = free_words < to_wrap ? free_words : to_wrap;
+    return data_ + (head & mask_);
+}
+
+void WordRing::commit(size_t n) {
+    // Data must be visible before readers can see the new head
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&head_->pos, head_->pos + n);
+}
+
+const uint32_t* WordRing::peek(int reader, size_t& n) const {
+    const size_t pos = readers_[reader].pos;
+    const size_t head = epicsAtomicGetSizeT(&head_->pos);
+    epicsAtomicReadMemoryBarrier();
+    const size_t to_wrap = capacity() - (pos & mask_);
+    n = head - pos < to_wrap ? head - pos : to_wrap;
+    return data_ + (pos & mask_);
+}
+
+void WordRing::consume(int reader, size_t n) {
+    // Reads of the consumed words must complete before the writer may reuse them;
+    // that is a load->store ordering, so both barriers are needed
+    epicsAtomicReadMemoryBarrier();
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&readers_[reader].pos, readers_[reader].pos + n);
+}
+
+size_t WordRing::written() const { return epicsAtomicGetSizeT(&head_->pos); }
+
+size_t WordRing::available(int reader) const {
+    return epicsAtomicGetSizeT(&head_->pos) - epicsAtomicGetSizeT(&readers_[reader].pos);
+}
+
+size_t WordRing::used() const { return epicsAtomicGetSizeT(&head_->pos) - slowest_reader(); }
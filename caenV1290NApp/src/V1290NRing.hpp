@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <epicsAtomic.h>
+
+#define RING_CACHE_LINE 64
+#define RING_MAX_READERS 8
+#define RING_DEFAULT_WORDS (1 << 20)
+
+/// \brief Single-producer/multi-consumer ring of raw Output Buffer words.
+///
+/// The readout thread is the only writer. Each consumer registers a reader and advances its
+/// own cursor, so no consumer ever takes the port lock or waits on another consumer. Cursors
+/// are free-running word counts; the storage size is a power of two so they are reduced to
+/// an index with a mask. The writer never overwrites words the slowest reader hasn't consumed.
+class WordRing {
+  public:
+    /// \param min_words Minimum capacity in words, rounded up to a power of two.
+    explicit WordRing(size_t min_words = RING_DEFAULT_WORDS);
+    ~WordRing();
+
+    /// \brief Registers a new reader positioned at the current write position.
+    /// \return Reader handle, or -1 if all reader slots are in use.
+    int add_reader();
+
+    /// \brief Releases a reader slot so it no longer holds back the writer.
+    void remove_reader(int reader);
+
+    /// \brief Returns the contiguous region the writer may fill next.
+    ///
+    /// Only the producer thread may call this.
+    /// \param n Set to the number of words that may be written at the returned pointer.
+    uint32_t* reserve(size_t& n);
+
+    /// \brief Publishes n words previously written into the reserved region.
+    void commit(size_t n);
+
+    /// \brief Returns the contiguous region of unread words for a reader.
+    /// \param reader Reader handle from add_reader().
+    /// \param n Set to the number of readable words at the returned pointer.
+    const uint32_t* peek(int reader, size_t& n) const;
+
+    /// \brief Marks n words as consumed by a reader.
+    void consume(int reader, size_t n);
+
+    /// \brief Free-running count of words committed so far.
+    size_t written() const;
+
+    /// \brief Free-running count of words a reader has consumed, comparable to written().
+    size_t position(int reader) const { return epicsAtomicGetSizeT(&readers_[reader].pos); }
+
+    /// \brief Words written but not yet consumed by the given reader.
+    size_t available(int reader) const;
+
+    /// \brief Words held back by the slowest active reader.
+    size_t used() const;
+
+    size_t capacity() const { return mask_ + 1; }
+
+  private:
+    WordRing(const WordRing&);
+    WordRing& operator=(const WordRing&);
+
+    // Each cursor sits on its own cache line so readers never false-share with the writer
+    struct Cursor {
+        size_t pos;
+        int active;
+        char pad[RING_CACHE_LINE - sizeof(size_t) - sizeof(int)];
+    };
+
+    size_t slowest_reader() const;
+
+    void* alloc_;
+    uint32_t* data_;
+    size_t mask_;
+    Cursor* head_;
+    Cursor* readers_;
+};
@@ -0,0 +1,640 @@
+#include <math.h>
+#include <string.h>
+
+#include <epicsThread.h>
+
+#include "V1290NSim.hpp"
+
+// How often the generator thread fires the triggers that came due
+static const double sim_tick_sec = 0.001;
+
+// Most triggers generated per lock hold, so readers interleave at high rates
+static const size_t sim_chunk_triggers = 256;
+
+// Window settings are in 25 ns clock cycles, measurements in 25 ps LSBs
+static const uint32_t LSB_PER_CLOCK = 1000;
+static const double LSB_PER_NS = 40.0;
+
+// Trailing edges in leading+trailing mode follow the leading edge by up to this many LSBs
+static const uint32_t MAX_PULSE_LSB = 4000;
+
+static inline size_t reg_index(uint32_t offset) { return (offset - Register::Control) / 2; }
+
+static void sim_thread_C(void* pPvt) {
+    SimBus* pSim = (SimBus*)pPvt;
+    pSim->run();
+}
+
+SimBus::SimBus(double trigger_rate, double hits_per_event, uint32_t seed)
+    : lock_(epicsMutexMustCreate()), microErrors_(0), rate_(trigger_rate), meanHits_(hits_per_event), clockNs_(0.0),
+      rng_(seed ? seed : 1), triggers_(0), lost_(0), generated_(0), isr_(NULL), isrArg_(NULL) {
+    reset();
+    epicsThreadCreate("V1290NSim", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackSmall),
+                      (EPICSTHREADFUNC)sim_thread_C, this);
+}
+
+void SimBus::reset() {
+    memset(regs_, 0, sizeof(regs_));
+    regs_[reg_index(Register::Control)] = Control::BerrEn | Control::CompEnable;
+    regs_[reg_index(Register::AlmostFullLevel)] = 64;
+    dummy32_ = 0;
+    testReg_ = 0;
+
+    trigMatch_ = 1;
+    edgeMode_ = 2;
+    headerTrailer_ = 1;
+    enablePattern_ = 0xFFFF;
+    windowWidth_ = 0x14;
+    windowOffset_ = 0xFFD8;
+    memset(settings_, 0, sizeof(settings_));
+    settings_[TdcConfigWord::SearchMargin] = 0x08;
+    settings_[TdcConfigWord::TriggerSubtraction] = 1;
+    settings_[TdcConfigWord::RejectMargin] = 0x04;
+    settings_[TdcConfigWord::Resolution] = 3;
+    settings_[TdcConfigWord::EventSize] = 9;
+    settings_[TdcConfigWord::ErrorMark] = 1;
+    settings_[TdcConfigWord::ErrorTypes] = 0x7FF;
+    settings_[TdcConfigWord::FifoSize] = 7;
+    opcode_ = 0;
+    argsWanted_ = 0;
+    nargs_ = 0;
+    replies_.clear();
+    clear();
+}
+
+void SimBus::clear() {
+    out_.clear();
+    eventWords_.clear();
+    fifo_.clear();
+    eventCounter_ = 0;
+    lostSinceEvent_ = 0;
+    statusSticky_ = 0;
+}
+
+void SimBus::set_trigger_rate(double hz) { rate_ = hz > 0 ? hz : 0.0; }
+
+void SimBus::set_hits_per_event(double mean) { meanHits_ = mean > 0 ? mean : 0.0; }
+
+uint32_t SimBus::next_random() {
+    // xorshift32, good enough for hit patterns and cheap under the lock
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 17;
+    rng_ ^= rng_ << 5;
+    return rng_;
+}
+
+size_t SimBus::poisson(double mean) {
+    if (mean <= 0) {
+        return 0;
+    }
+    // Knuth's method loses precision for large means, so add up smaller draws instead
+    if (mean > 30.0) {
+        const int parts = (int)ceil(mean / 30.0);
+        size_t sum = 0;
+        for (int k = 0; k < parts; k++) {
+            sum += poisson(mean / parts);
+        }
+        return sum;
+    }
+    const double limit = exp(-mean);
+    double p = 1.0;
+    size_t k = 0;
+    do {
+        k++;
+        p *= ((next_random() >> 8) + 1) * (1.0 / 16777217.0);
+    } while (p > limit);
+    return k - 1;
+}
+
+void SimBus::store_event(double t_ns) {
+    const uint16_t control = regs_[reg_index(Register::Control)];
+    const uint32_t geo = regs_[reg_index(Register::GeoAddr)] & DataWord::GeoMask;
+    const uint32_t count = eventCounter_++;
+    triggers_++;
+
+    // Measurement words first, then wrap them in the event structure
+    uint32_t* hits = scratch_;
+    size_t nhits = 0;
+    int enabled[MAX_CHANNELS];
+    int nenabled = 0;
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        if (enablePattern_ & (1 << ch)) {
+            enabled[nenabled++] = ch;
+        }
+    }
+    size_t want = nenabled ? poisson(meanHits_) : 0;
+    want = want < SIM_MAX_HITS ? want : SIM_MAX_HITS;
+    const uint32_t span = windowWidth_ ? windowWidth_ * LSB_PER_CLOCK : LSB_PER_CLOCK;
+    const uint32_t base = trigMatch_ ? 0 : (uint32_t)(t_ns * LSB_PER_NS);
+    for (size_t k = 0; k < want; k++) {
+        const uint32_t ch = enabled[next_random() % nenabled];
+        const uint32_t t = base + next_random() % span;
+        const uint32_t word = (ch & DataWord::ChannelMask) << DataWord::ChannelShift;
+        // Pair mode (0) reports the leading edge here, the pulse width field is not modelled
+        if (edgeMode_ != 1) {
+            hits[nhits++] = word | (t & DataWord::TimeMask);
+        }
+        if (edgeMode_ == 1 || edgeMode_ == 3) {
+            const uint32_t tt = t + 1 + next_random() % MAX_PULSE_LSB;
+            hits[nhits++] = word | ((uint32_t)Edge::Trailing << DataWord::EdgeShift) | (tt & DataWord::TimeMask);
+        }
+    }
+
+    if (!trigMatch_) {
+        // Continuous storage: hits go straight to the Output Buffer, no event structure
+        if (out_.size() + nhits > OUTBUF_MAX_WORDS) {
+            lost_++;
+            statusSticky_ |= Status::TriggerLost;
+            return;
+        }
+        out_.insert(out_.end(), hits, hits + nhits);
+        generated_ += nhits;
+        return;
+    }
+
+    if (nhits == 0 && !(control & Control::EmptyEvent)) {
+        return;
+    }
+
+    uint32_t* ev = scratch_ + 2 * SIM_MAX_HITS;
+    size_t n = 0;
+    const uint32_t evid = count & DataWord::EventIdMask;
+    const uint32_t bunch = (uint32_t)(t_ns / 25.0) & DataWord::BunchIdMask;
+    ev[n++] = (DataWord::GlobalHeader << DataWord::TypeShift) |
+              ((count & DataWord::EventCountMask) << DataWord::EventCountShift) | geo;
+    for (uint32_t tdc = 0; tdc < MAX_CHANNELS / 8; tdc++) {
+        const size_t first = n;
+        if (headerTrailer_) {
+            ev[n++] = (DataWord::TdcHeader << DataWord::TypeShift) | (tdc << DataWord::TdcShift) |
+                      (evid << DataWord::EventIdShift) | bunch;
+        }
+        for (size_t k = 0; k < nhits; k++) {
+            if (((hits[k] >> DataWord::ChannelShift) & DataWord::ChannelMask) >> 3 == tdc) {
+                ev[n++] = hits[k];
+            }
+        }
+        if (headerTrailer_) {
+            const uint32_t words = (uint32_t)(n - first + 1);
+            ev[n++] = (DataWord::TdcTrailer << DataWord::TypeShift) | (tdc << DataWord::TdcShift) |
+                      (evid << DataWord::EventIdShift) | (words & DataWord::TdcWordCountMask);
+        }
+    }
+    if (control & Control::EtttEnable) {
+        ev[n++] = (DataWord::Ettt << DataWord::TypeShift) | ((uint32_t)(t_ns / 800.0) & DataWord::EtttMask);
+    }
+    const uint32_t status = lostSinceEvent_ ? 0x4 : 0;
+    n++;
+    ev[n - 1] = (DataWord::GlobalTrailer << DataWord::TypeShift) | (status << DataWord::StatusShift) |
+                (((uint32_t)n & DataWord::WordCountMask) << DataWord::WordCountShift) | geo;
+    const size_t pad = (control & Control::Align64) && (n & 1) ? 1 : 0;
+
+    const bool fifo = (control & Control::EventFifoEn) != 0;
+    if (out_.size() + n + pad > OUTBUF_MAX_WORDS || (fifo && fifo_.size() >= SIM_EVENT_FIFO_DEPTH)) {
+        lost_++;
+        lostSinceEvent_ = 1;
+        statusSticky_ |= Status::TriggerLost;
+        return;
+    }
+    out_.insert(out_.end(), ev, ev + n);
+    if (pad) {
+        out_.push_back(DataWord::Filler << DataWord::TypeShift);
+    }
+    eventWords_.push_back((uint32_t)(n + pad));
+    if (fifo) {
+        fifo_.push_back(((count & EventFifo::EventCountMask) << EventFifo::EventCountShift) |
+                        ((uint32_t)n & EventFifo::WordCountMask));
+    }
+    lostSinceEvent_ = 0;
+    generated_ += n + pad;
+}
+
+size_t SimBus::trigger(size_t n, double dt_ns) {
+    size_t stored = 0;
+    for (size_t done = 0; done < n;) {
+        const size_t k = (n - done) < sim_chunk_triggers ? (n - done) : sim_chunk_triggers;
+        epicsMutexLock(lock_);
+        for (size_t i = 0; i < k; i++) {
+            const size_t lost = lost_;
+            clockNs_ += dt_ns;
+            store_event(clockNs_);
+            stored += lost_ == lost ? 1 : 0;
+        }
+        epicsMutexUnlock(lock_);
+        interrupt_if_due();
+        done += k;
+    }
+    return stored;
+}
+
+void SimBus::interrupt_if_due() {
+    epicsMutexLock(lock_);
+    const bool due = isr_ && regs_[reg_index(Register::IntLevel)] &&
+                     out_.size() >= regs_[reg_index(Register::AlmostFullLevel)];
+    epicsMutexUnlock(lock_);
+    // Called without the lock, the ISR masks the interrupt through write16_isr()
+    if (due) {
+        isr_(isrArg_);
+    }
+}
+
+void SimBus::run() {
+    epicsTimeStamp last, now;
+    epicsTimeGetCurrent(&last);
+    double carry = 0.0;
+
+    while (true) {
+        epicsThreadSleep(sim_tick_sec);
+        epicsTimeGetCurrent(&now);
+        const double dt = epicsTimeDiffInSeconds(&now, &last);
+        last = now;
+
+        const double rate = rate_;
+        if (rate <= 0) {
+            carry = 0.0;
+            epicsMutexLock(lock_);
+            clockNs_ += dt * 1e9;
+            epicsMutexUnlock(lock_);
+            interrupt_if_due();
+            continue;
+        }
+
+        const double due = rate * dt + carry;
+        const size_t n = (size_t)due;
+        carry = due - n;
+        if (n > 0) {
+            trigger(n, 1e9 / rate);
+        } else {
+            interrupt_if_due();
+        }
+    }
+}
+
+uint32_t SimBus::pop_word() {
+    if (out_.empty()) {
+        return DataWord::Filler << DataWord::TypeShift;
+    }
+    const uint32_t w = out_.front();
+    out_.pop_front();
+    if (!eventWords_.empty() && --eventWords_.front() == 0) {
+        eventWords_.pop_front();
+    }
+    return w;
+}
+
+void SimBus::apply_micro() {
+    const int select = opcode_ & Opcode::SelectMask;
+    switch (opcode_ & Opcode::CodeMask) {
+    case Opcode::SetTriggerMatch:
+        trigMatch_ = 1;
+        break;
+    case Opcode::SetContinuous:
+        trigMatch_ = 0;
+        break;
+    case Opcode::ReadAcquisitionMode:
+        replies_.push_back(trigMatch_);
+        break;
+    case Opcode::SetEdgeDetectionMode:
+        edgeMode_ = args_[0] & 0x3;
+        break;
+    case Opcode::ReadEdgeDetectionMode:
+        replies_.push_back(edgeMode_);
+        break;
+    case Opcode::EnableTDCHeaderTrailer:
+        headerTrailer_ = 1;
+        break;
+    case Opcode::DisableTDCHeaderTrailer:
+        headerTrailer_ = 0;
+        break;
+    case Opcode::TDCHeaderTrailerStatus:
+        replies_.push_back(headerTrailer_);
+        break;
+    case Opcode::EnableChannel:
+        enablePattern_ |= select < MAX_CHANNELS ? (1 << select) : 0;
+        break;
+    case Opcode::DisableChannel:
+        enablePattern_ &= select < MAX_CHANNELS ? ~(1 << select) : 0xFFFF;
+        break;
+    case Opcode::EnableAllChannels:
+        enablePattern_ = 0xFFFF;
+        break;
+    case Opcode::DisableAllChannels:
+        enablePattern_ = 0;
+        break;
+    case Opcode::WriteEnablePattern:
+        enablePattern_ = args_[0];
+        break;
+    case Opcode::WriteEnablePattern32:
+        // Write-only like every opcode with data words: both words are taken, nothing is
+        // queued for reading. The model has one pattern, the low word of TDC 0 is it.
+        if (select == 0) {
+            enablePattern_ = args_[0];
+        }
+        break;
+    case Opcode::ReadEnablePattern:
+        replies_.push_back(enablePattern_);
+        break;
+    case Opcode::ReadEnablePattern32:
+        replies_.push_back(enablePattern_);
+        replies_.push_back(0);
+        break;
+    case Opcode::SetWindowWidth:
+        windowWidth_ = args_[0] & 0xFFF;
+        break;
+    case Opcode::SetWindowOffset:
+        windowOffset_ = args_[0];
+        break;
+    case Opcode::SetSearchMargin:
+        settings_[TdcConfigWord::SearchMargin] = args_[0] & 0xFFF;
+        break;
+    case Opcode::SetRejectMargin:
+        settings_[TdcConfigWord::RejectMargin] = args_[0] & 0xFFF;
+        break;
+    case Opcode::EnableTriggerSubtraction:
+        settings_[TdcConfigWord::TriggerSubtraction] = 1;
+        break;
+    case Opcode::DisableTriggerSubtraction:
+        settings_[TdcConfigWord::TriggerSubtraction] = 0;
+        break;
+    case Opcode::ReadTriggerConfig:
+        // The board returns the offset as a 12-bit field
+        replies_.push_back(windowWidth_);
+        replies_.push_back(windowOffset_ & 0xFFF);
+        replies_.push_back(settings_[TdcConfigWord::SearchMargin]);
+        replies_.push_back(settings_[TdcConfigWord::RejectMargin]);
+        replies_.push_back(settings_[TdcConfigWord::TriggerSubtraction]);
+        break;
+    case Opcode::SetEdgeResolution:
+    case Opcode::SetPairResolution:
+        settings_[TdcConfigWord::Resolution] = args_[0];
+        break;
+    case Opcode::ReadResolution:
+        replies_.push_back(settings_[TdcConfigWord::Resolution]);
+        break;
+    case Opcode::SetDeadTime:
+        settings_[TdcConfigWord::DeadTime] = args_[0] & 0x3;
+        break;
+    case Opcode::ReadDeadTime:
+        replies_.push_back(settings_[TdcConfigWord::DeadTime]);
+        break;
+    case Opcode::SetEventSize:
+        settings_[TdcConfigWord::EventSize] = args_[0] & 0xF;
+        break;
+    case Opcode::ReadEventSize:
+        replies_.push_back(settings_[TdcConfigWord::EventSize]);
+        break;
+    case Opcode::EnableErrorMark:
+    case Opcode::DisableErrorMark:
+        settings_[TdcConfigWord::ErrorMark] = (opcode_ & Opcode::CodeMask) == Opcode::EnableErrorMark;
+        break;
+    case Opcode::EnableErrorBypass:
+    case Opcode::DisableErrorBypass:
+        settings_[TdcConfigWord::ErrorBypass] = (opcode_ & Opcode::CodeMask) == Opcode::EnableErrorBypass;
+        break;
+    case Opcode::SetErrorTypes:
+        settings_[TdcConfigWord::ErrorTypes] = args_[0] & 0x7FF;
+        break;
+    case Opcode::ReadErrorTypes:
+        replies_.push_back(settings_[TdcConfigWord::ErrorTypes]);
+        break;
+    case Opcode::SetFifoSize:
+        settings_[TdcConfigWord::FifoSize] = args_[0] & 0x7;
+        break;
+    case Opcode::ReadFifoSize:
+        replies_.push_back(settings_[TdcConfigWord::FifoSize]);
+        break;
+    case Opcode::SetGlobalOffset:
+        settings_[TdcConfigWord::GlobalOffsetCoarse] = args_[0] & 0xFFF;
+        settings_[TdcConfigWord::GlobalOffsetFine] = args_[1] & 0x1F;
+        break;
+    case Opcode::ReadGlobalOffset:
+        replies_.push_back(settings_[TdcConfigWord::GlobalOffsetCoarse]);
+        replies_.push_back(settings_[TdcConfigWord::GlobalOffsetFine]);
+        break;
+    case Opcode::SetChannelAdjust:
+        if (select < MAX_CHANNELS) {
+            settings_[TdcConfigWord::ChannelAdjust + select] = args_[0] & 0xFF;
+        }
+        break;
+    case Opcode::ReadChannelAdjust:
+        replies_.push_back(select < MAX_CHANNELS ? settings_[TdcConfigWord::ChannelAdjust + select] : 0);
+        break;
+    case Opcode::ReadMicroRevision:
+        replies_.push_back(SIM_FIRMWARE_REV);
+        break;
+    default:
+        // Unmodelled opcodes are accepted and ignored
+        break;
+    }
+}
+
+static int micro_args(uint16_t opcode) {
+    switch (opcode & Opcode::CodeMask) {
+    case Opcode::SetWindowWidth:
+    case Opcode::SetWindowOffset:
+    case Opcode::SetSearchMargin:
+    case Opcode::SetRejectMargin:
+    case Opcode::SetEdgeDetectionMode:
+    case Opcode::SetEdgeResolution:
+    case Opcode::SetPairResolution:
+    case Opcode::SetDeadTime:
+    case Opcode::SetEventSize:
+    case Opcode::SetErrorTypes:
+    case Opcode::SetFifoSize:
+    case Opcode::WriteEnablePattern:
+    case Opcode::SetChannelAdjust:
+    case Opcode::SetRcAdjust:
+        return 1;
+    case Opcode::WriteEnablePattern32:
+    case Opcode::SetGlobalOffset:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+bool SimBus::read16(uint32_t offset, uint16_t& value) {
+    if (offset & 1 || offset > Register::Dummy16 || (offset >= OUTBUF_WINDOW_BYTES && offset < Register::Control)) {
+        return false;
+    }
+
+    epicsMutexLock(lock_);
+    if (offset < OUTBUF_WINDOW_BYTES) {
+        value = (uint16_t)pop_word();
+    } else {
+        switch (offset) {
+        case Register::Status: {
+            const size_t words = out_.size();
+            value = statusSticky_;
+            value |= words ? Status::DataReady : 0;
+            value |= words >= regs_[reg_index(Register::AlmostFullLevel)] ? Status::AlmostFull : 0;
+            value |= words >= OUTBUF_MAX_WORDS ? Status::Full : 0;
+            value |= trigMatch_ ? Status::TrgMatchMode : 0;
+            value |= headerTrailer_ ? Status::HeaderEn : 0;
+            break;
+        }
+        case Register::EventStored:
+            value = (uint16_t)eventWords_.size();
+            break;
+        case Register::EventFifoStored:
+            value = (uint16_t)fifo_.size();
+            break;
+        case Register::EventFifoStatus:
+            value = (fifo_.empty() ? 0 : EventFifo::DataReady) |
+                    (fifo_.size() >= SIM_EVENT_FIFO_DEPTH ? EventFifo::Full : 0);
+            break;
+        case Register::FirmwareRev:
+            value = SIM_FIRMWARE_REV;
+            break;
+        case Register::MicroHandshake:
+            // Like the board, the micro takes no new word until every reply has been read
+            value = replies_.empty() ? Handshake::WriteOk : Handshake::ReadOk;
+            break;
+        case Register::Micro:
+            value = 0;
+            if (replies_.empty()) {
+                // Read without ReadOk, e.g. after a write-only opcode
+                microErrors_++;
+            } else {
+                value = replies_.front();
+                replies_.pop_front();
+            }
+            break;
+        default:
+            value = regs_[reg_index(offset)];
+            break;
+        }
+    }
+    epicsMutexUnlock(lock_);
+    return true;
+}
+
+bool SimBus::write16(uint32_t offset, uint16_t value) {
+    if (offset & 1 || offset < Register::Control || offset > Register::Dummy16) {
+        return false;
+    }
+    if (offset == Register::SwTrigger) {
+        trigger(1);
+        return true;
+    }
+
+    epicsMutexLock(lock_);
+    switch (offset) {
+    case Register::Control:
+        // Like the board, writing Control clears the module
+        regs_[reg_index(offset)] = value;
+        clear();
+        break;
+    case Register::ModReset:
+        reset();
+        break;
+    case Register::SwClear:
+        clear();
+        break;
+    case Register::SwEventReset:
+        eventCounter_ = 0;
+        break;
+    case Register::Micro:
+        if (!replies_.empty()) {
+            // Written without WriteOk, the word is lost like on the board
+            microErrors_++;
+        } else if (argsWanted_ > 0) {
+            args_[nargs_++] = value;
+            if (--argsWanted_ == 0) {
+                apply_micro();
+            }
+        } else {
+            opcode_ = value;
+            nargs_ = 0;
+            argsWanted_ = micro_args(value);
+            replies_.clear();
+            if (argsWanted_ == 0) {
+                apply_micro();
+            }
+        }
+        break;
+    case Register::Status:
+    case Register::EventStored:
+    case Register::FirmwareRev:
+    case Register::MicroHandshake:
+    case Register::EventFifoStored:
+    case Register::EventFifoStatus:
+        break;
+    default:
+        regs_[reg_index(offset)] = value;
+        break;
+    }
+    epicsMutexUnlock(lock_);
+    return true;
+}
+
+bool SimBus::read32(uint32_t offset, uint32_t& value) {
+    bool ok = true;
+    epicsMutexLock(lock_);
+    if (offset < OUTBUF_WINDOW_BYTES && !(offset & 3)) {
+        // With BERR_EN an empty buffer ends the cycle with a bus error instead of a filler
+        if (out_.empty() && (regs_[reg_index(Register::Control)] & Control::BerrEn)) {
+            ok = false;
+        } else {
+            value = pop_word();
+        }
+    } else if (offset == Register::EventCounter) {
+        value = eventCounter_;
+    } else if (offset == Register::EventFifo) {
+        value = 0;
+        if (!fifo_.empty()) {
+            value = fifo_.front();
+            fifo_.pop_front();
+        }
+    } else if (offset == Register::TestReg) {
+        value = testReg_;
+    } else if (offset == Register::Dummy32) {
+        value = dummy32_;
+    } else {
+        ok = false;
+    }
+    epicsMutexUnlock(lock_);
+    return ok;
+}
+
+bool SimBus::write32(uint32_t offset, uint32_t value) {
+    bool ok = true;
+    epicsMutexLock(lock_);
+    if (offset == Register::TestReg) {
+        testReg_ = value;
+        // TEST_FIFO mode loads Testreg writes into the Output Buffer
+        if ((regs_[reg_index(Register::Control)] & Control::TestFifoEnable) && out_.size() < OUTBUF_MAX_WORDS) {
+            out_.push_back(value);
+        }
+    } else if (offset == Register::Dummy32) {
+        dummy32_ = value;
+    } else {
+        ok = false;
+    }
+    epicsMutexUnlock(lock_);
+    return ok;
+}
+
+uint32_t SimBus::outbuf_word(size_t i) {
+    epicsMutexLock(lock_);
+    const uint32_t w = pop_word();
+    epicsMutexUnlock(lock_);
+    return w;
+}
+
+void SimBus::outbuf_dword(size_t i, uint32_t* dst) { outbuf_words(i, dst, 2); }
+
+void SimBus::outbuf_words(size_t i, uint32_t* dst, size_t n) {
+    epicsMutexLock(lock_);
+    for (size_t k = 0; k < n; k++) {
+        dst[k] = pop_word();
+    }
+    epicsMutexUnlock(lock_);
+}
+
+bool SimBus::connect_interrupt(int level, int vector, V1290NIsr isr, void* arg) {
+    epicsMutexLock(lock_);
+    isr_ = isr;
+    isrArg_ = arg;
+    epicsMutexUnlock(lock_);
+    return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#include "V1290NBus.hpp"
+#include "V1290NConfig.hpp"
+
+// Firmware revision the model reports, 0.5
+#define SIM_FIRMWARE_REV 0x05
+
+// Event FIFO depth of the real board
+#define SIM_EVENT_FIFO_DEPTH 1024
+
+// Most hits the generator puts in one event
+#define SIM_MAX_HITS 1024
+
+/// \brief Software model of a V1290N behind the V1290NBus interface.
+///
+/// Emulates the register map, the micro controller opcodes and handshake, the Output Buffer,
+/// the Event FIFO and the interrupt on AlmostFullLevel. A generator thread fires triggers at a
+/// configurable rate with Poisson distributed hit multiplicity over the enabled channels; the
+/// data words follow the acquisition, edge, header and Control settings the driver programmed.
+/// Triggers that don't fit in the Output Buffer (or Event FIFO) are lost, as on the board.
+class SimBus : public V1290NBus {
+  public:
+    /// \param trigger_rate Generator trigger rate in Hz, 0 for software triggers only.
+    /// \param hits_per_event Mean number of hits per trigger.
+    /// \param seed Seed of the hit generator.
+    SimBus(double trigger_rate = 0.0, double hits_per_event = 4.0, uint32_t seed = 1);
+
+    virtual bool read16(uint32_t offset, uint16_t& value);
+    virtual bool write16(uint32_t offset, uint16_t value);
+    virtual bool read32(uint32_t offset, uint32_t& value);
+    virtual bool write32(uint32_t offset, uint32_t value);
+    virtual uint32_t outbuf_word(size_t i);
+    virtual void outbuf_dword(size_t i, uint32_t* dst);
+    virtual void outbuf_words(size_t i, uint32_t* dst, size_t n);
+    virtual bool connect_interrupt(int level, int vector, V1290NIsr isr, void* arg);
+
+    void set_trigger_rate(double hz);
+    void set_hits_per_event(double mean);
+
+    /// \brief Fires n triggers immediately, spaced dt_ns apart on the model's time base.
+    /// \return Number of triggers stored, the rest were lost.
+    size_t trigger(size_t n = 1, double dt_ns = 0.0);
+
+    size_t triggers() const { return triggers_; }
+    size_t triggers_lost() const { return lost_; }
+    size_t words_generated() const { return generated_; }
+
+    /// \brief Micro register accesses that broke the handshake, e.g. a read with nothing to
+    /// read or a write while replies were still pending.
+    size_t micro_errors() const { return microErrors_; }
+
+    /// \brief Generator loop, runs on the model's own thread.
+    void run();
+
+  private:
+    void reset();
+    void clear();
+    void apply_micro();
+    void store_event(double t_ns);
+    void interrupt_if_due();
+    uint32_t pop_word();
+    uint32_t next_random();
+    size_t poisson(double mean);
+
+    epicsMutexId lock_;
+
+    // Registers without side effects, indexed by (offset - Register::Control) / 2
+    uint16_t regs_[(Register::Dummy16 - Register::Control) / 2 + 1];
+    uint32_t dummy32_;
+    uint32_t testReg_;
+
+    // Micro controller settings and the opcode being assembled
+    int trigMatch_;
+    int edgeMode_;
+    int headerTrailer_;
+    uint16_t enablePattern_;
+    uint16_t windowWidth_;
+    uint16_t windowOffset_;
+    // Settings the generator doesn't act on, kept only to be read back, indexed by TdcConfigWord
+    uint16_t settings_[TdcConfigWord::Count];
+    uint16_t opcode_;
+    int argsWanted_;
+    int nargs_;
+    uint16_t args_[4];
+    std::deque<uint16_t> replies_;
+    size_t microErrors_;
+
+    // Output Buffer, its per-event word counts (trigger matching) and the Event FIFO
+    std::deque<uint32_t> out_;
+    std::deque<uint32_t> eventWords_;
+    std::deque<uint32_t> fifo_;
+    uint32_t eventCounter_;
+    int lostSinceEvent_;
+    uint16_t statusSticky_;
+
+    // Generator
+    double rate_;
+    double meanHits_;
+    double clockNs_;
+    uint32_t rng_;
+    size_t triggers_;
+    size_t lost_;
+    size_t generated_;
+    uint32_t scratch_[4 * SIM_MAX_HITS + 16];
+
+    V1290NIsr isr_;
+    void* isrArg_;
+};
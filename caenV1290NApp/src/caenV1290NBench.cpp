@@ -0,0 +1,255 @@
+// Throughput and latency benchmark of the CaenV1290N readout pipeline.
+//
+// Runs the real driver (readout, ring, decode, processing and optionally the file writer) on
+// the simulated board and sweeps trigger rate and hit multiplicity. For every point it reports
+// the words and events per second that made it through, the fraction of triggers the board
+// lost, and percentiles of the time each stage spends per call. The first rate losing more
+// than 0.1% of the triggers is reported as the loss onset for that multiplicity.
+//
+// usage: caenV1290NBench [-t seconds] [-r rate,...] [-m hits,...] [-b mode] [-f] [-i] [-w path] [-c]
+//   -t  seconds per point (default 2)
+//   -r  trigger rates in Hz (default 1000,10000,100000,1000000)
+//   -m  mean hits per event (default 4)
+//   -b  READOUT_MODE, 0=D32 1=BLT32 2=MBLT64 (default 1)
+//   -f  size blocks from the Event FIFO
+//   -i  wake the readout thread from the simulated interrupt instead of polling
+//   -w  also record to segment files with this path prefix
+//   -c  record decoded batches in the columnar format instead of raw words, and read the
+//       recording back through its block index when done
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <asynInt32SyncIO.h>
+#include <asynOctetSyncIO.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+
+#include "V1290NReplay.hpp"
+#include "V1290NSim.hpp"
+#include "drvCaenV1290N.hpp"
+
+#define BENCH_PORT "V1290N_BENCH"
+#define MAX_POINTS 32
+
+// Loss fraction that counts as the onset of trigger loss
+static const double loss_onset = 0.001;
+
+// Long enough for poll() to publish the counters after the generator stops
+static const double settle_sec = 1.0;
+
+static const double sync_timeout = 1.0;
+
+static const char* stage_names[Stage::Count] = {"readout", "decode", "process", "write", "drain"};
+
+struct Counters {
+    size_t triggers;
+    size_t lost;
+    epicsInt32 words;
+    epicsInt32 events;
+    epicsInt32 stalls;
+};
+
+static asynUser* connect_param(const char* param) {
+    asynUser* pasynUser = NULL;
+    if (asynInt32SyncIO->connect(BENCH_PORT, 0, &pasynUser, param) != asynSuccess) {
+        printf("caenV1290NBench: cannot connect to %s\n", param);
+        exit(1);
+    }
+    return pasynUser;
+}
+
+static void write_param(const char* param, epicsInt32 value) {
+    asynUser* pasynUser = connect_param(param);
+    if (asynInt32SyncIO->write(pasynUser, value, sync_timeout) != asynSuccess) {
+        printf("caenV1290NBench: cannot write %s\n", param);
+        exit(1);
+    }
+    asynInt32SyncIO->disconnect(pasynUser);
+}
+
+static size_t parse_list(const char* arg, double* out) {
+    size_t n = 0;
+    char* end = NULL;
+    while (*arg && n < MAX_POINTS) {
+        out[n++] = strtod(arg, &end);
+        if (end == arg) {
+            return n - 1;
+        }
+        arg = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+// Reads a columnar recording back: each segment's footer index must match a rebuild from its
+// block headers, and seeking to every block's first event must decode a block starting there.
+static bool verify_columnar(const char* path) {
+    ColumnarReader footer, scan;
+    HitBatch* batch = new HitBatch;
+    size_t blocks = 0;
+    bool ok = true;
+    int segment = 0;
+    for (; ok && footer.open(path, segment); segment++) {
+        ok = !footer.scanned() && scan.open(path, segment, true) && scan.blocks() == footer.blocks();
+        for (size_t i = 0; ok && i < footer.blocks(); i++) {
+            const IndexEntry& entry = footer.entry(i);
+            const long found = footer.find_event(entry.first_event);
+            ok = scan.entry(i).offset == entry.offset && scan.entry(i).first_event == entry.first_event &&
+                 found >= 0 && footer.read((size_t)found, *batch) && batch->nevents > 0 &&
+                 batch->event_count[0] == entry.first_event;
+        }
+        blocks += footer.blocks();
+    }
+    delete batch;
+    ok = ok && blocks > 0;
+    printf("columnar index: %d segments, %lu blocks, %s\n", segment, (unsigned long)blocks,
+           ok ? "verified" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    double seconds = 2.0;
+    double rates[MAX_POINTS] = {1e3, 1e4, 1e5, 1e6};
+    size_t nrates = 4;
+    double mults[MAX_POINTS] = {4};
+    size_t nmults = 1;
+    int mode = ReadoutMode::Blt32;
+    int fifo = 0;
+    int irq = 0;
+    const char* path = NULL;
+    int columnar = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* next = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(argv[i], "-t") && next) {
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-r") && next) {
+            nrates = parse_list(argv[++i], rates);
+        } else if (!strcmp(argv[i], "-m") && next) {
+            nmults = parse_list(argv[++i], mults);
+        } else if (!strcmp(argv[i], "-b") && next) {
+            mode = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-f")) {
+            fifo = 1;
+        } else if (!strcmp(argv[i], "-i")) {
+            irq = 1;
+        } else if (!strcmp(argv[i], "-w") && next) {
+            path = argv[++i];
+        } else if (!strcmp(argv[i], "-c")) {
+            columnar = 1;
+        } else {
+            printf("usage: %s [-t seconds] [-r rate,...] [-m hits,...] [-b mode] [-f] [-i] [-w path] [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (seconds <= 0 || nrates == 0 || nmults == 0) {
+        printf("caenV1290NBench: nothing to run\n");
+        return 1;
+    }
+
+    SimBus* sim = new SimBus(0.0, mults[0]);
+    CaenV1290N* drv = new CaenV1290N(BENCH_PORT, sim, irq, 0);
+
+    write_param(READOUT_MODE_STR, mode);
+    write_param(EVENT_FIFO_ENABLE_STR, fifo);
+    write_param(READOUT_ENABLE_STR, 1);
+    if (path) {
+        asynUser* pasynUser = NULL;
+        size_t nwrite = 0;
+        if (asynOctetSyncIO->connect(BENCH_PORT, 0, &pasynUser, FILE_PATH_STR) != asynSuccess ||
+            asynOctetSyncIO->write(pasynUser, path, strlen(path), sync_timeout, &nwrite) != asynSuccess) {
+            printf("caenV1290NBench: cannot set %s\n", FILE_PATH_STR);
+            return 1;
+        }
+        write_param(FILE_FORMAT_STR, columnar ? FileFormat::Columnar : FileFormat::Raw);
+        write_param(FILE_ENABLE_STR, 1);
+    }
+
+    asynUser* wordsUser = connect_param(WORDS_READ_STR);
+    asynUser* eventsUser = connect_param(EVENTS_DECODED_STR);
+    asynUser* stallsUser = connect_param(RING_STALLS_STR);
+
+    printf("mode %d, event FIFO %s, %s, %.1f s per point%s%s\n", mode, fifo ? "on" : "off",
+           irq ? "interrupt" : "polled", seconds, path ? ", recording to " : "", path ? path : "");
+
+    for (size_t im = 0; im < nmults; im++) {
+        sim->set_hits_per_event(mults[im]);
+        double onset = 0.0;
+
+        printf("\nhits/event %.1f\n", mults[im]);
+        printf("%12s %12s %12s %9s %7s", "trig/s", "words/s", "events/s", "lost", "stalls");
+        for (int s = 0; s < Stage::Count; s++) {
+            char title[32];
+            sprintf(title, "%s p50/p99/max us", stage_names[s]);
+            printf("  %26s", title);
+        }
+        printf("\n");
+
+        for (size_t ir = 0; ir < nrates; ir++) {
+            Counters before, after;
+            epicsThreadSleep(settle_sec);
+            for (int s = 0; s < Stage::Count; s++) {
+                drv->latency(s).clear();
+            }
+            before.triggers = sim->triggers();
+            before.lost = sim->triggers_lost();
+            asynInt32SyncIO->read(wordsUser, &before.words, sync_timeout);
+            asynInt32SyncIO->read(eventsUser, &before.events, sync_timeout);
+            asynInt32SyncIO->read(stallsUser, &before.stalls, sync_timeout);
+
+            epicsTimeStamp start, stop;
+            epicsTimeGetCurrent(&start);
+            sim->set_trigger_rate(rates[ir]);
+            epicsThreadSleep(seconds);
+            sim->set_trigger_rate(0.0);
+            epicsTimeGetCurrent(&stop);
+            const double elapsed = epicsTimeDiffInSeconds(&stop, &start);
+
+            // Let the pipeline drain and poll() publish the final counters
+            epicsThreadSleep(settle_sec);
+            after.triggers = sim->triggers();
+            after.lost = sim->triggers_lost();
+            asynInt32SyncIO->read(wordsUser, &after.words, sync_timeout);
+            asynInt32SyncIO->read(eventsUser, &after.events, sync_timeout);
+            asynInt32SyncIO->read(stallsUser, &after.stalls, sync_timeout);
+
+            // The published counters are 32 bits, so difference them modulo 2^32
+            const double words = (epicsUInt32)after.words - (epicsUInt32)before.words;
+            const double events = (epicsUInt32)after.events - (epicsUInt32)before.events;
+            const double stalls = (epicsUInt32)after.stalls - (epicsUInt32)before.stalls;
+            const double triggers = (double)(after.triggers - before.triggers);
+            const double loss = triggers > 0 ? (after.lost - before.lost) / triggers : 0.0;
+            if (onset == 0.0 && loss > loss_onset) {
+                onset = rates[ir];
+            }
+
+            printf("%12.0f %12.0f %12.0f %8.3f%% %7.0f", triggers / elapsed, words / elapsed, events / elapsed,
+                   100.0 * loss, stalls);
+            for (int s = 0; s < Stage::Count; s++) {
+                const LatencyHistogram& h = drv->latency(s);
+                printf("  %8.1f/%8.1f/%8.1f", h.percentile(0.5) * 1e-3, h.percentile(0.99) * 1e-3, h.max() * 1e-3);
+            }
+            printf("\n");
+        }
+
+        if (onset > 0.0) {
+            printf("trigger loss onset: %.0f Hz\n", onset);
+        } else {
+            printf("trigger loss onset: above %.0f Hz\n", rates[nrates - 1]);
+        }
+    }
+
+    if (path) {
+        write_param(FILE_ENABLE_STR, 0);
+        epicsThreadSleep(settle_sec);
+        if (columnar && !verify_columnar(path)) {
+            return 1;
+        }
+    }
+    if (sim->micro_errors()) {
+        printf("micro handshake errors: %d\n", (int)sim->micro_errors());
+        return 1;
+    }
+    return 0;
+}
@@ -1,8 +1,10 @@
 #include <devLib.h>
+#include <epicsAtomic.h>
 #include <epicsExport.h>
 #include <iocsh.h>
 
 #include "V1290N.hpp"
+#include "V1290NSim.hpp"
 #include "drvCaenV1290N.hpp"
 
 static void poll_thread_C(void* pPvt) {
@@ -10,33 +12,121 @@ static void poll_thread_C(void* pPvt) {
     pCaenV1290N->poll();
 }
 
-// TODO: make configurable
-const double poll_period_sec = 0.5;
+static void readout_thread_C(void* pPvt) {
+    CaenV1290N* pCaenV1290N = (CaenV1290N*)pPvt;
+    pCaenV1290N->readout();
+}
 
-const int ASYN_INTERFACE_MASK = asynInt32Mask | asynUInt32DigitalMask | asynFloat64Mask | asynDrvUserMask;
-const int ASYN_INTERRUPT_MASK = asynInt32Mask | asynUInt32DigitalMask | asynFloat64Mask;
+static void writer_thread_C(void* pPvt) {
+    CaenV1290N* pCaenV1290N = (CaenV1290N*)pPvt;
+    pCaenV1290N->writer();
+}
 
-CaenV1290N::CaenV1290N(const char* portName, int baseAddress)
-    : asynPortDriver(portName, MAX_CHANNELS,
-            ASYN_INTERFACE_MASK, ASYN_INTERRUPT_MASK,
-            ASYN_MULTIDEVICE, 1, 0, 0) {
+static void readout_isr_C(void* pPvt) {
+    CaenV1290N* pCaenV1290N = (CaenV1290N*)pPvt;
+    pCaenV1290N->isr();
+}
 
-    // // initialize
-    volatile void* ptr;
-    const size_t EXTENT = 0x10000;
-    // const size_t EXTENT = 0x1204*4; // what should this be?
-    if (devRegisterAddress("CAEN_V1290N", atVMEA32, baseAddress, EXTENT, &ptr)) {
-        printf("ERROR: devRegisterAddress failed. Cannot initialize board.\n");
-        return;
-    }
+static void micro_thread_C(void* pPvt) {
+    CaenV1290N* pCaenV1290N = (CaenV1290N*)pPvt;
+    pCaenV1290N->micro();
+}
+
+static void process_thread_C(void* pPvt) {
+    CaenV1290N* pCaenV1290N = (CaenV1290N*)pPvt;
+    pCaenV1290N->process();
+}
+
+// Default period of each PollGroup, 0 polls the group only on demand
+static const double poll_period_sec[PollGroup::Count] = {0.1, 0.5, 0.0};
+
+// Status group period while the board is close to losing data, and how long it stays that fast
+const double poll_fast_period_sec = 0.02;
+const double poll_fast_hold_sec = 5.0;
+
+// Longest poll() sleeps, so period changes take effect promptly
+const double poll_max_sleep_sec = 0.5;
+
+// Default period of the rate meters
+const double rate_period_sec = 0.5;
+
+// How long the readout thread sleeps when the Output Buffer is empty or readout is disabled
+const double readout_idle_sec = 0.001;
+
+// With interrupts, how long the readout thread waits before checking for data below AlmostFullLevel
+const double readout_irq_timeout_sec = 0.05;
+
+// Longest a replay at recorded speed waits for the next block, longer pauses in the recording
+// are skipped
+const double replay_max_gap_sec = 1.0;
+
+// How long the writer thread sleeps when idle or caught up with the readout
+const double writer_idle_sec = 0.01;
+
+// Default size of each recorded segment file, in MB
+const int default_segment_mb = 256;
+
+// How long wait_micro_handshake polls back to back before it starts sleeping
+const int default_micro_spin_us = 500;
+
+// Batches that can wait for the micro thread
+const int micro_queue_depth = 16;
+
+// Decoded batches queued to the writer thread, most of the export pool
+const int file_queue_depth = EXPORT_POOL_SIZE - 2;
+
+// Default period of the background check of the shadow cache against the board, 0 disables it
+const double shadow_verify_sec = 60.0;
+
+// Default continuous mode frame duration
+const double frame_duration_sec = 1e-3;
+
+// Trigger time tag units frames are counted in, and the longest frame whose hit times fit in 32 bits
+const double frame_tick_sec = 800e-9;
+const double max_frame_duration_sec = 0.1;
+
+// Opcode reading back each Shadow setting, the words it returns and which of them is the setting
+struct ShadowRead {
+    uint16_t opcode;
+    uint16_t nread;
+    uint16_t index;
+};
+static const ShadowRead shadow_read[Shadow::Count] = {
+    {Opcode::ReadAcquisitionMode, 1, 0}, {Opcode::ReadEdgeDetectionMode, 1, 0},
+    {Opcode::TDCHeaderTrailerStatus, 1, 0}, {Opcode::ReadEnablePattern, 1, 0},
+    {Opcode::ReadResolution, 1, 0}, {Opcode::ReadTriggerConfig, 5, 4}};
+
+const int ASYN_INTERFACE_MASK = asynInt32Mask | asynUInt32DigitalMask | asynFloat64Mask | asynInt32ArrayMask |
+                                asynInt64ArrayMask | asynFloat64ArrayMask | asynGenericPointerMask | asynOctetMask | asynDrvUserMask;
+const int ASYN_INTERRUPT_MASK = asynInt32Mask | asynUInt32DigitalMask | asynFloat64Mask | asynInt32ArrayMask |
+                                asynInt64ArrayMask | asynFloat64ArrayMask | asynGenericPointerMask;
 
-    // ????
-    // if (sysBusToLocalAdrs(0x09, (char*)baseAddress, (char**)ptr)) {
-    // printf("ERROR: sysBusToLocalAdrs failed. Cannot initialize board.\n");
-    // return;
-    // }
+CaenV1290N::CaenV1290N(const char* portName, V1290NBus* bus, int intLevel, int intVector, SegmentReader* replay)
+    : asynPortDriver(portName, MAX_CHANNELS,
+            ASYN_INTERFACE_MASK, ASYN_INTERRUPT_MASK,
+            ASYN_MULTIDEVICE, 1, 0, 0),
+      bus_(bus), ring_(RING_DEFAULT_WORDS), readoutLock_(epicsMutexMustCreate()), readoutEnable_(0), readoutMode_(ReadoutMode::D32), bltEventNumber_(0),
+      wordsRead_(0), eventsRead_(0), blocksRead_(0),
+      ringStalls_(0), groupMember_(0), eventFifo_(0), fifoPendingWords_(0), fifoPendingEvents_(0), intLevel_(intLevel), intVector_(intVector),
+      readoutEvent_(epicsEventMustCreate(epicsEventEmpty)), irqArmed_(0), irqCount_(0), filterDirty_(1), shared_(pool_.acquire()), exportEnable_(0), exportSequence_(0), exportDropped_(0), exportChannel_(new epicsInt32[HIT_BATCH_CAPACITY]), hitsDecoded_(0), eventsDecoded_(0),
+      hist_(new TimeHistograms), histAxis_(new epicsFloat64[MAX_HIST_BINS]), histResolution_(3), histDirty_(1), histPeriod_(1.0),
+      pairEdges_(0), tot_(new TimeHistograms), totAxis_(new epicsFloat64[MAX_HIST_BINS]), totDirty_(1),
+      coinc_(new CoincidenceEngine), coincAxis_(new epicsFloat64[MAX_COINCIDENCES * MAX_HIST_BINS]),
+      continuous_(0), frameTicks_((uint32_t)(frame_duration_sec / frame_tick_sec + 0.5)), framesDirty_(1),
+      framesBoundary_(0), timeScale_(DataWord::EtttLsbTdc), ratePeriod_(rate_period_sec), pollFastPeriod_(poll_fast_period_sec),
+      pollFastHold_(poll_fast_hold_sec), pollFastUntil_(0), lastEventCounter_(0), triggerCount_(0),
+      replay_(replay), replayNext_(NULL), replayLeft_(0), replaySpeed_(1.0), replayLoop_(0), replayRestart_(0),
+      replayDone_(0), replayPaced_(false), replaySettingsKnown_(false), replayBaseMono_(0), fileEnable_(0), fileBatches_(0), fileQueue_(epicsMessageQueueCreate(file_queue_depth, sizeof(SharedBatch*))),
+      fileDropped_(0), lastStatus_(0), almostFullSince_(0), almostFullCount_(0), fullCount_(0),
+      triggerLostCount_(0), eventsTriggerLost_(0), eventsOverflow_(0), eventsStoredPeak_(0), storedFailures_(0), microQueue_(epicsMessageQueueCreate(micro_queue_depth, sizeof(MicroBatch*))),
+      microLock_(epicsMutexMustCreate()), microSpinUs_(default_micro_spin_us), microErrors_(0),
+      shadowVerifyPeriod_(shadow_verify_sec), shadowMismatches_(0), shadowResyncDue_(0) {
 
-    base = (volatile uint8_t*)ptr;
+    memset(channelHits_, 0, sizeof(channelHits_));
+    memcpy(pollPeriod_, poll_period_sec, sizeof(pollPeriod_));
+    memset(shadow_, 0, sizeof(shadow_));
+    memset(shadowValid_, 0, sizeof(shadowValid_));
+    memset(&config_, 0, sizeof(config_));
 
     // Read the Firmware Revision Register
     uint16_t rev;
@@ -60,63 +150,789 @@ CaenV1290N::CaenV1290N(const char* portName, int baseAddress)
     createParam(DUMMY16_STR, asynParamInt32, &dummy16Id_);
     createParam(DUMMY32_STR, asynParamInt32, &dummy32Id_);
     createParam(DEV_PARAM_STR, asynParamInt32, &devParamId_);
+    createParam(READOUT_ENABLE_STR, asynParamInt32, &readoutEnableId_);
+    createParam(READOUT_MODE_STR, asynParamInt32, &readoutModeId_);
+    createParam(BLT_EVENT_NUMBER_STR, asynParamInt32, &bltEventNumberId_);
+    createParam(WORDS_READ_STR, asynParamInt32, &wordsReadId_);
+    createParam(EVENTS_READ_STR, asynParamInt32, &eventsReadId_);
+    createParam(BLOCKS_READ_STR, asynParamInt32, &blocksReadId_);
+    createParam(RING_USED_STR, asynParamInt32, &ringUsedId_);
+    createParam(RING_STALLS_STR, asynParamInt32, &ringStallsId_);
+    createParam(HITS_DECODED_STR, asynParamInt32, &hitsDecodedId_);
+    createParam(EVENTS_DECODED_STR, asynParamInt32, &eventsDecodedId_);
+    createParam(UNKNOWN_WORDS_STR, asynParamInt32, &unknownWordsId_);
+    createParam(ALMOST_FULL_LEVEL_STR, asynParamInt32, &almostFullLevelId_);
+    createParam(IRQ_COUNT_STR, asynParamInt32, &irqCountId_);
+    createParam(EVENT_FIFO_ENABLE_STR, asynParamInt32, &eventFifoEnableId_);
+    createParam(HIST_MIN_STR, asynParamInt32, &histMinId_);
+    createParam(HIST_BIN_WIDTH_STR, asynParamInt32, &histBinWidthId_);
+    createParam(HIST_NBINS_STR, asynParamInt32, &histNbinsId_);
+    createParam(HIST_RESET_STR, asynParamInt32, &histResetId_);
+    createParam(HIST_PERIOD_STR, asynParamFloat64, &histPeriodId_);
+    createParam(HIST_LEADING_STR, asynParamInt32Array, &histLeadingId_);
+    createParam(HIST_TRAILING_STR, asynParamInt32Array, &histTrailingId_);
+    createParam(HIST_AXIS_STR, asynParamFloat64Array, &histAxisId_);
+    createParam(TOT_HIST_MIN_STR, asynParamInt32, &totHistMinId_);
+    createParam(TOT_HIST_BIN_WIDTH_STR, asynParamInt32, &totHistBinWidthId_);
+    createParam(TOT_HIST_NBINS_STR, asynParamInt32, &totHistNbinsId_);
+    createParam(TOT_HIST_STR, asynParamInt32Array, &totHistId_);
+    createParam(TOT_HIST_AXIS_STR, asynParamFloat64Array, &totHistAxisId_);
+    createParam(CHANNEL_HITS_STR, asynParamInt32, &channelHitsId_);
+    createParam(CHANNEL_RATE_STR, asynParamFloat64, &channelRateId_);
+    createParam(TRIGGER_COUNT_STR, asynParamInt32, &triggerCountId_);
+    createParam(TRIGGER_RATE_STR, asynParamFloat64, &triggerRateId_);
+    createParam(HIT_RATE_STR, asynParamFloat64, &hitRateId_);
+    createParam(EVENT_RATE_STR, asynParamFloat64, &eventRateId_);
+    createParam(RATE_WINDOW_STR, asynParamFloat64, &rateWindowId_);
+    createParam(RATE_PERIOD_STR, asynParamFloat64, &ratePeriodId_);
+    createParam(FILE_PATH_STR, asynParamOctet, &filePathId_);
+    createParam(FILE_ENABLE_STR, asynParamInt32, &fileEnableId_);
+    createParam(FILE_SEGMENT_SIZE_STR, asynParamInt32, &fileSegmentSizeId_);
+    createParam(FILE_SEGMENT_STR, asynParamInt32, &fileSegmentId_);
+    createParam(FILE_BYTES_WRITTEN_STR, asynParamFloat64, &fileBytesWrittenId_);
+    createParam(FILE_FORMAT_STR, asynParamInt32, &fileFormatId_);
+    createParam(FILE_BATCHES_DROPPED_STR, asynParamInt32, &fileBatchesDroppedId_);
+    createParam(SHADOW_RESYNC_STR, asynParamInt32, &shadowResyncId_);
+    createParam(SHADOW_VERIFY_PERIOD_STR, asynParamFloat64, &shadowVerifyPeriodId_);
+    createParam(SHADOW_MISMATCHES_STR, asynParamInt32, &shadowMismatchesId_);
+    createParam(MICRO_SPIN_US_STR, asynParamInt32, &microSpinUsId_);
+    createParam(MICRO_ERRORS_STR, asynParamInt32, &microErrorsId_);
+    createParam(CONFIG_STR, asynParamInt32Array, &configId_);
+    createParam(FRAME_DURATION_STR, asynParamFloat64, &frameDurationId_);
+    createParam(COINC_START_STR, asynParamInt32, &coincStartId_);
+    createParam(COINC_STOPS_STR, asynParamInt32, &coincStopsId_);
+    createParam(COINC_WINDOW_MIN_STR, asynParamInt32, &coincWindowMinId_);
+    createParam(COINC_WINDOW_MAX_STR, asynParamInt32, &coincWindowMaxId_);
+    createParam(COINC_HIST_MIN_STR, asynParamInt32, &coincHistMinId_);
+    createParam(COINC_HIST_BIN_WIDTH_STR, asynParamInt32, &coincHistBinWidthId_);
+    createParam(COINC_HIST_NBINS_STR, asynParamInt32, &coincHistNbinsId_);
+    createParam(COINC_RESET_STR, asynParamInt32, &coincResetId_);
+    createParam(COINC_COUNT_STR, asynParamInt32, &coincCountId_);
+    createParam(COINC_PAIRS_STR, asynParamInt32, &coincPairsId_);
+    createParam(COINC_HIST_STR, asynParamInt32Array, &coincHistId_);
+    createParam(COINC_AXIS_STR, asynParamFloat64Array, &coincAxisId_);
+    createParam(EXPORT_STR, asynParamGenericPointer, &exportId_);
+    createParam(EXPORT_ENABLE_STR, asynParamInt32, &exportEnableId_);
+    createParam(EXPORT_SEQUENCE_STR, asynParamInt32, &exportSequenceId_);
+    createParam(EXPORT_DROPPED_STR, asynParamInt32, &exportDroppedId_);
+    createParam(EXPORT_TIME_STR, asynParamInt32Array, &exportTimeId_);
+    createParam(EXPORT_CHANNEL_STR, asynParamInt32Array, &exportChannelId_);
+    createParam(EXPORT_EVENT_STR, asynParamInt64Array, &exportEventId_);
+    createParam(EXPORT_WIDTH_STR, asynParamInt32Array, &exportWidthId_);
+    createParam(FILTER_CHANNELS_STR, asynParamInt32, &filterChannelsId_);
+    createParam(FILTER_EDGES_STR, asynParamInt32, &filterEdgesId_);
+    createParam(FILTER_TIME_WINDOW_STR, asynParamInt32, &filterTimeWindowId_);
+    createParam(FILTER_TIME_MIN_STR, asynParamInt32, &filterTimeMinId_);
+    createParam(FILTER_TIME_MAX_STR, asynParamInt32, &filterTimeMaxId_);
+    createParam(FILTER_MIN_HITS_STR, asynParamInt32, &filterMinHitsId_);
+    createParam(FILTER_MAX_HITS_STR, asynParamInt32, &filterMaxHitsId_);
+    createParam(FILTER_DROP_EMPTY_STR, asynParamInt32, &filterDropEmptyId_);
+    createParam(FILTER_HITS_DROPPED_STR, asynParamInt32, &filterHitsDroppedId_);
+    createParam(FILTER_EVENTS_DROPPED_STR, asynParamInt32, &filterEventsDroppedId_);
+    createParam(REPLAY_SPEED_STR, asynParamFloat64, &replaySpeedId_);
+    createParam(REPLAY_LOOP_STR, asynParamInt32, &replayLoopId_);
+    createParam(REPLAY_RESTART_STR, asynParamInt32, &replayRestartId_);
+    createParam(REPLAY_SEGMENT_STR, asynParamInt32, &replaySegmentId_);
+    createParam(REPLAY_DONE_STR, asynParamInt32, &replayDoneId_);
+    createParam(STATS_RESET_STR, asynParamInt32, &statsResetId_);
+    createParam(ALMOST_FULL_COUNT_STR, asynParamInt32, &almostFullCountId_);
+    createParam(FULL_COUNT_STR, asynParamInt32, &fullCountId_);
+    createParam(TRIGGER_LOST_COUNT_STR, asynParamInt32, &triggerLostCountId_);
+    createParam(EVENTS_TRIGGER_LOST_STR, asynParamInt32, &eventsTriggerLostId_);
+    createParam(EVENTS_OVERFLOW_STR, asynParamInt32, &eventsOverflowId_);
+    createParam(EVENTS_STORED_PEAK_STR, asynParamInt32, &eventsStoredPeakId_);
+    createParam(BLOCK_WORDS_MEAN_STR, asynParamFloat64, &blockWordsMeanId_);
+    createParam(BLOCK_WORDS_MAX_STR, asynParamInt32, &blockWordsMaxId_);
+    createParam(BLOCK_WORDS_HIST_STR, asynParamInt32Array, &blockWordsHistId_);
+    createParam(BLOCK_WORDS_AXIS_STR, asynParamFloat64Array, &blockWordsAxisId_);
+    createParam(STAGE_COUNT_STR, asynParamInt32, &stageCountId_);
+    createParam(STAGE_MEAN_STR, asynParamFloat64, &stageMeanId_);
+    createParam(STAGE_P50_STR, asynParamFloat64, &stageP50Id_);
+    createParam(STAGE_P99_STR, asynParamFloat64, &stageP99Id_);
+    createParam(STAGE_MAX_STR, asynParamFloat64, &stageMaxId_);
+    createParam(STAGE_HIST_STR, asynParamInt32Array, &stageHistId_);
+    createParam(STAGE_AXIS_STR, asynParamFloat64Array, &stageAxisId_);
+    createParam(POLL_PERIOD_STR, asynParamFloat64, &pollPeriodId_);
+    createParam(POLL_FAST_PERIOD_STR, asynParamFloat64, &pollFastPeriodId_);
+    createParam(POLL_FAST_HOLD_STR, asynParamFloat64, &pollFastHoldId_);
+    createParam(POLL_FAST_STR, asynParamInt32, &pollFastId_);
+
+    setIntegerParam(readoutEnableId_, readoutEnable_);
+    setIntegerParam(readoutModeId_, readoutMode_);
+    setIntegerParam(eventFifoEnableId_, eventFifo_);
+    setIntegerParam(histMinId_, 0);
+    setIntegerParam(histBinWidthId_, 16);
+    setIntegerParam(histNbinsId_, 1024);
+    setDoubleParam(histPeriodId_, histPeriod_);
+    setIntegerParam(totHistMinId_, 0);
+    setIntegerParam(totHistBinWidthId_, 4);
+    setIntegerParam(totHistNbinsId_, 1024);
+    epicsTimeGetCurrent(&histPublished_);
+    setDoubleParam(rateWindowId_, 5.0);
+    setDoubleParam(ratePeriodId_, ratePeriod_);
+    readD32(Register::EventCounter, lastEventCounter_);
+    setStringParam(filePathId_, "");
+    setIntegerParam(fileEnableId_, 0);
+    setIntegerParam(fileSegmentSizeId_, default_segment_mb);
+    setIntegerParam(fileFormatId_, FileFormat::Raw);
+    setIntegerParam(fileBatchesDroppedId_, 0);
+    setDoubleParam(shadowVerifyPeriodId_, shadowVerifyPeriod_);
+    setIntegerParam(shadowMismatchesId_, 0);
+    setIntegerParam(microSpinUsId_, microSpinUs_);
+    setIntegerParam(microErrorsId_, 0);
+    setDoubleParam(frameDurationId_, frameTicks_ * frame_tick_sec);
+    setIntegerParam(exportEnableId_, 0);
+    setIntegerParam(exportSequenceId_, 0);
+    setIntegerParam(exportDroppedId_, 0);
+    setDoubleParam(replaySpeedId_, replaySpeed_);
+    setIntegerParam(replayLoopId_, replayLoop_);
+    setIntegerParam(replaySegmentId_, 0);
+    setIntegerParam(replayDoneId_, 0);
+    setIntegerParam(filterChannelsId_, 0xFFFF);
+    setIntegerParam(filterEdgesId_, FilterEdge::Both);
+    setIntegerParam(filterTimeWindowId_, 0);
+    setIntegerParam(filterTimeMinId_, 0);
+    setIntegerParam(filterTimeMaxId_, DataWord::TimeMask);
+    setIntegerParam(filterMinHitsId_, 0);
+    setIntegerParam(filterMaxHitsId_, 0);
+    setIntegerParam(filterDropEmptyId_, 0);
+    setIntegerParam(filterHitsDroppedId_, 0);
+    setIntegerParam(filterEventsDroppedId_, 0);
+    for (int group = 0; group < PollGroup::Count; group++) {
+        setDoubleParam(group, pollPeriodId_, pollPeriod_[group]);
+        if (group > 0) {
+            callParamCallbacks(group);
+        }
+    }
+    setDoubleParam(pollFastPeriodId_, pollFastPeriod_);
+    setDoubleParam(pollFastHoldId_, pollFastHold_);
+    setIntegerParam(pollFastId_, 0);
+    for (int slot = 0; slot < MAX_COINCIDENCES; slot++) {
+        coincDirty_[slot] = 1;
+        setIntegerParam(slot, coincStartId_, -1);
+        setIntegerParam(slot, coincStopsId_, 0);
+        setIntegerParam(slot, coincWindowMinId_, 0);
+        setIntegerParam(slot, coincWindowMaxId_, 4000);
+        setIntegerParam(slot, coincHistMinId_, 0);
+        setIntegerParam(slot, coincHistBinWidthId_, 4);
+        setIntegerParam(slot, coincHistNbinsId_, 1024);
+        setIntegerParam(slot, coincCountId_, 0);
+        setIntegerParam(slot, coincPairsId_, 0);
+        callParamCallbacks(slot);
+    }
+
+    // Every micro controller transaction, including the initial shadow read, goes through here
+    epicsThreadCreate("CaenV1290NMicro", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), (EPICSTHREADFUNC)micro_thread_C, this);
+
+    // The board may have been configured before the IOC started, so fill the cache from it
+    if (!resync_shadow()) {
+        printf("WARNING: could not read the micro controller settings, readbacks will retry.\n");
+    }
+    if (readD16(Register::BltEventNumber, bltEventNumber_)) {
+        setIntegerParam(bltEventNumberId_, bltEventNumber_);
+    }
+    uint16_t almostFull = 0;
+    if (readD16(Register::AlmostFullLevel, almostFull)) {
+        setIntegerParam(almostFullLevelId_, almostFull);
+    }
+
+    if (intLevel_ && !connect_interrupt()) {
+        printf("ERROR: failed to connect interrupt, falling back to polled readout.\n");
+        intLevel_ = 0;
+    }
 
     epicsThreadCreate("CaenV1290NPoller", epicsThreadPriorityLow,
                       epicsThreadGetStackSize(epicsThreadStackMedium), (EPICSTHREADFUNC)poll_thread_C, this);
+    epicsThreadCreate("CaenV1290NReadout", intLevel_ ? epicsThreadPriorityHigh : epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), (EPICSTHREADFUNC)readout_thread_C, this);
+    epicsThreadCreate("CaenV1290NProcess", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), (EPICSTHREADFUNC)process_thread_C, this);
+    epicsThreadCreate("CaenV1290NWriter", epicsThreadPriorityMedium,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), (EPICSTHREADFUNC)writer_thread_C, this);
 }
 
 bool CaenV1290N::wait_micro_handshake(uint16_t mask, uint16_t timeout) {
+    const epicsUInt64 start = epicsMonotonicGet();
+    const epicsUInt64 spin_ns = (epicsUInt64)microSpinUs_ * 1000;
+    const epicsUInt64 timeout_ns = (epicsUInt64)timeout * 1000000;
     while (true) {
         uint16_t hs;
         if (!readD16(Register::MicroHandshake, hs)) {
             return false;
         }
-        if ((hs & mask) == 0 && (timeout > 0)) {
+        if (hs & mask) {
+            return true;
+        }
+        const epicsUInt64 elapsed = epicsMonotonicGet() - start;
+        if (elapsed >= timeout_ns) {
+            return false;
+        }
+        if (elapsed >= spin_ns) {
             epicsThreadSleep(0.001);
-            timeout--;
-        } else {
-            break;
         }
     }
-    return (timeout > 0) ? true : false;
 };
 
+void CaenV1290N::execute_micro(MicroBatch& batch) {
+    for (size_t i = 0; i < batch.size(); i++) {
+        MicroCommand& cmd = batch.command(i);
+        bool ok = wait_micro_handshake(Handshake::WriteOk) && writeD16(Register::Micro, cmd.opcode);
+        for (size_t k = 0; ok && k < cmd.nwrite; k++) {
+            ok = wait_micro_handshake(Handshake::WriteOk) && writeD16(Register::Micro, cmd.data[k]);
+        }
+        for (size_t k = 0; ok && k < cmd.nread; k++) {
+            ok = wait_micro_handshake(Handshake::ReadOk) && readD16(Register::Micro, cmd.data[k]);
+        }
+        if (!ok) {
+            printf("execute_micro: opcode 0x%04X failed, %d of %d commands done\n", cmd.opcode, (int)i,
+                   (int)batch.size());
+            // The opcode may have gone out without all of its data, so the board state is unknown
+            shadow_invalidate();
+            microErrors_++;
+            return;
+        }
+        if (cmd.nwrite || cmd.nread == 0) {
+            shadow_written(cmd.opcode, cmd.data, cmd.nwrite);
+        }
+        batch.completed = i + 1;
+    }
+}
+
+void CaenV1290N::micro() {
+    while (true) {
+        MicroBatch* batch = NULL;
+        if (epicsMessageQueueReceive(microQueue_, &batch, sizeof(batch)) != sizeof(batch) || !batch) {
+            continue;
+        }
+        epicsMutexLock(microLock_);
+        execute_micro(*batch);
+        epicsMutexUnlock(microLock_);
+        epicsEventSignal(batch->done);
+    }
+}
+
+bool CaenV1290N::run_micro(MicroBatch& batch) {
+    MicroBatch* pbatch = &batch;
+    batch.completed = 0;
+    if (epicsMessageQueueSend(microQueue_, &pbatch, sizeof(pbatch)) != 0) {
+        return false;
+    }
+    // No timeout: the handshake waits are bounded, and the batch must outlive its execution
+    epicsEventMustWait(batch.done);
+    return batch.ok();
+}
+
 bool CaenV1290N::write_micro(uint16_t opcode, uint16_t val) {
-    if (!wait_micro_handshake(Handshake::WriteOk)) {
-        printf("write_micro: wait_micro_handshake returned error");
+    MicroBatch batch;
+    batch.write(opcode, val);
+    return run_micro(batch);
+}
+
+bool CaenV1290N::write_micro(uint16_t opcode) {
+    MicroBatch batch;
+    batch.write(opcode);
+    return run_micro(batch);
+}
+
+bool CaenV1290N::read_micro(uint16_t opcode, uint16_t& value) {
+    MicroBatch batch;
+    batch.read(opcode);
+    if (!run_micro(batch)) {
         return false;
     }
-    writeD16(Register::Micro, opcode);
+    value = batch.command(0).data[0];
+    return true;
+}
+
+void CaenV1290N::shadow_written(uint16_t opcode, const uint16_t* vals, size_t nvals) {
+    int field = -1;
+    uint16_t value = nvals ? vals[0] : 0;
+    const uint16_t select = opcode & Opcode::SelectMask;
+    switch (opcode & Opcode::CodeMask) {
+    case Opcode::SetTriggerMatch:
+        field = Shadow::AcquisitionMode;
+        value = 1;
+        break;
+    case Opcode::SetContinuous:
+        field = Shadow::AcquisitionMode;
+        value = 0;
+        break;
+    case Opcode::SetEdgeDetectionMode:
+        field = nvals ? Shadow::EdgeDetectMode : -1;
+        break;
+    case Opcode::EnableTDCHeaderTrailer:
+        field = Shadow::HeaderTrailer;
+        value = 1;
+        break;
+    case Opcode::DisableTDCHeaderTrailer:
+        field = Shadow::HeaderTrailer;
+        value = 0;
+        break;
+    case Opcode::WriteEnablePattern:
+        field = nvals ? Shadow::EnablePattern : -1;
+        break;
+    case Opcode::EnableAllChannels:
+        field = Shadow::EnablePattern;
+        value = 0xFFFF;
+        break;
+    case Opcode::DisableAllChannels:
+        field = Shadow::EnablePattern;
+        value = 0;
+        break;
+    case Opcode::EnableChannel:
+    case Opcode::DisableChannel:
+        // Only a known pattern can be updated one channel at a time
+        if (!shadowValid_[Shadow::EnablePattern] || select >= MAX_CHANNELS) {
+            shadowValid_[Shadow::EnablePattern] = 0;
+            return;
+        }
+        field = Shadow::EnablePattern;
+        value = shadow_[Shadow::EnablePattern];
+        if ((opcode & Opcode::CodeMask) == Opcode::EnableChannel) {
+            value |= 1 << select;
+        } else {
+            value &= ~(1 << select);
+        }
+        break;
+    case Opcode::SetEdgeResolution:
+    case Opcode::SetPairResolution:
+        field = nvals ? Shadow::Resolution : -1;
+        break;
+    case Opcode::EnableTriggerSubtraction:
+        field = Shadow::TriggerSubtraction;
+        value = 1;
+        break;
+    case Opcode::DisableTriggerSubtraction:
+        field = Shadow::TriggerSubtraction;
+        value = 0;
+        break;
+    case Opcode::WriteEnablePattern32:
+        // Per-TDC patterns don't map onto the board pattern without the TDC's channel range
+        shadowValid_[Shadow::EnablePattern] = 0;
+        return;
+    case Opcode::LoadDefaultConfig:
+    case Opcode::LoadUserConfig:
+        // Every setting may have changed, including the ones the decoder depends on, so have
+        // poll() read them all back rather than wait for a readback to find out
+        shadow_invalidate();
+        shadowResyncDue_ = 1;
+        return;
+    default:
+        return;
+    }
+    if (field >= 0) {
+        shadow_store(field, value);
+    }
+}
+
+void CaenV1290N::shadow_store(int field, uint16_t value) {
+    shadow_[field] = value;
+    shadowValid_[field] = 1;
+    if (field == Shadow::AcquisitionMode && continuous_ != (value == 0)) {
+        continuous_ = value == 0;
+        frames_changed();
+    }
+    if (field == Shadow::EdgeDetectMode) {
+        pairEdges_ = value == 3;
+    }
+    if (field == Shadow::Resolution && (value & 0x3) != histResolution_) {
+        // The axes are in ns, so rebuild them at the new LSB
+        histResolution_ = value & 0x3;
+        histDirty_ = 1;
+        totDirty_ = 1;
+        for (int slot = 0; slot < MAX_COINCIDENCES; slot++) {
+            coincDirty_[slot] = 1;
+        }
+    }
+
+    // Timestamps need all the settings the scale depends on, until then the last scale stays
+    if (shadowValid_[Shadow::AcquisitionMode] && shadowValid_[Shadow::EdgeDetectMode] &&
+        shadowValid_[Shadow::Resolution] && shadowValid_[Shadow::TriggerSubtraction]) {
+        const uint32_t scale = Decoder::time_scale(
+            shadow_[Shadow::AcquisitionMode] == 0, shadow_[Shadow::EdgeDetectMode] & 0x3,
+            shadow_[Shadow::Resolution] & 0x3, (shadow_[Shadow::TriggerSubtraction] & 1) != 0);
+        if (scale != timeScale_) {
+            timeScale_ = scale;
+            frames_changed();
+        }
+    }
+}
+
+void CaenV1290N::frames_changed() {
+    epicsAtomicSetSizeT(&framesBoundary_, ring_.written());
+    // The boundary must be visible before the flag
+    epicsAtomicWriteMemoryBarrier();
+    framesDirty_ = 1;
+}
+
+void CaenV1290N::shadow_invalidate() { memset(shadowValid_, 0, sizeof(shadowValid_)); }
+
+bool CaenV1290N::read_shadow(int field, uint16_t& value) {
+    epicsMutexLock(microLock_);
+    const int valid = shadowValid_[field];
+    value = shadow_[field];
+    epicsMutexUnlock(microLock_);
+    if (valid) {
+        return true;
+    }
 
-    if (!wait_micro_handshake(Handshake::WriteOk)) {
-        printf("write_micro: wait_micro_handshake returned error");
+    MicroBatch batch;
+    batch.read(shadow_read[field].opcode, shadow_read[field].nread);
+    if (!run_micro(batch)) {
         return false;
     }
-    writeD16(Register::Micro, val);
+    const uint16_t v16 = batch.command(0).data[shadow_read[field].index];
+    epicsMutexLock(microLock_);
+    shadow_store(field, v16);
+    epicsMutexUnlock(microLock_);
+    value = v16;
     return true;
 }
 
-bool CaenV1290N::write_micro(uint16_t opcode) {
-    if (!wait_micro_handshake(Handshake::WriteOk)) {
-        printf("write_micro: wait_micro_handshake returned error");
+bool CaenV1290N::resync_shadow() {
+    MicroBatch batch;
+    for (int field = 0; field < Shadow::Count; field++) {
+        batch.read(shadow_read[field].opcode, shadow_read[field].nread);
+    }
+    run_micro(batch);
+
+    epicsMutexLock(microLock_);
+    for (int field = 0; field < Shadow::Count; field++) {
+        if ((size_t)field >= batch.completed) {
+            shadowValid_[field] = 0;
+            continue;
+        }
+        const uint16_t v16 = batch.command(field).data[shadow_read[field].index];
+        if (shadowValid_[field] && shadow_[field] != v16) {
+            printf("CaenV1290N: shadow of micro setting %d was 0x%04X, board has 0x%04X\n", field, shadow_[field],
+                   v16);
+            shadowMismatches_++;
+        }
+        shadow_store(field, v16);
+    }
+    epicsMutexUnlock(microLock_);
+    return batch.ok();
+}
+
+bool CaenV1290N::apply_config(const TdcConfig& config) {
+    MicroBatch batch;
+    if (!tdc_config_read(batch)) {
+        return false;
+    }
+    const size_t nsnapshot = batch.size();
+    if (!tdc_config_write(config, batch)) {
+        return false;
+    }
+    if (run_micro(batch)) {
+        return true;
+    }
+    if (batch.completed <= nsnapshot) {
+        // Nothing was written yet
+        return false;
+    }
+
+    TdcConfig previous = config_;
+    tdc_config_parse(batch, 0, previous);
+    printf("CaenV1290N: configuration failed after %d of %d writes, restoring the previous one\n",
+           (int)(batch.completed - nsnapshot), (int)(batch.size() - nsnapshot));
+    MicroBatch restore;
+    tdc_config_write(previous, restore);
+    if (!run_micro(restore)) {
+        printf("CaenV1290N: restoring the previous configuration failed\n");
+    }
+    return false;
+}
+
+bool CaenV1290N::snapshot_config(TdcConfig& config) {
+    MicroBatch batch;
+    config = config_;
+    return tdc_config_read(batch) && run_micro(batch) && tdc_config_parse(batch, 0, config);
+}
+
+bool CaenV1290N::configure_readout(int mode) {
+    uint16_t control = 0;
+    if (!readD16(Register::Control, control)) {
+        return false;
+    }
+
+    uint16_t wanted = control;
+    if (mode == ReadoutMode::Blt32 || mode == ReadoutMode::Mblt64) {
+        wanted &= ~Control::BerrEn;
+    }
+    if (mode == ReadoutMode::Mblt64) {
+        wanted |= Control::Align64;
+    } else {
+        wanted &= ~Control::Align64;
+    }
+
+    // Writing Control clears the module, so only do it when something actually changes. Callers
+    // hold readoutLock_, so the Event FIFO entries already popped can be dropped with it.
+    if (wanted != control) {
+        if (!writeD16(Register::Control, wanted)) {
+            return false;
+        }
+        fifoPendingWords_ = 0;
+        fifoPendingEvents_ = 0;
+    }
+    return true;
+}
+
+bool CaenV1290N::write_control(uint16_t value, uint16_t keep) {
+    epicsMutexLock(readoutLock_);
+    uint16_t control = 0;
+    bool ok = !keep || readD16(Register::Control, control);
+    if (ok) {
+        value = (value & ~keep) | (control & keep);
+        ok = writeD16(Register::Control, value);
+    }
+    if (ok) {
+        // The write clears the module and may switch the Event FIFO on or off
+        eventFifo_ = (value & Control::EventFifoEn) ? 1 : 0;
+        fifoPendingWords_ = 0;
+        fifoPendingEvents_ = 0;
+    }
+    epicsMutexUnlock(readoutLock_);
+
+    if (ok) {
+        lock();
+        setIntegerParam(eventFifoEnableId_, eventFifo_);
+        callParamCallbacks();
+        unlock();
+    }
+    return ok;
+}
+
+bool CaenV1290N::connect_interrupt() {
+    if (intLevel_ < 1 || intLevel_ > 7 || intVector_ < 0 || intVector_ > 0xFF) {
+        printf("connect_interrupt: invalid level %d or vector 0x%X\n", intLevel_, intVector_);
+        return false;
+    }
+    if (!writeD16(Register::IntLevel, 0) || !writeD16(Register::IntVector, intVector_)) {
+        return false;
+    }
+    if (!bus_->connect_interrupt(intLevel_, intVector_, readout_isr_C, this)) {
         return false;
     }
-    writeD16(Register::Micro, opcode);
+    arm_interrupt();
     return true;
 }
 
-bool CaenV1290N::read_micro(uint16_t opcode, uint16_t& value) {
-    if (!wait_micro_handshake(Handshake::WriteOk)) {
-        printf("read_micro: wait_micro_handshake returned error");
+bool CaenV1290N::set_chain(uint16_t cbltAddr, uint16_t ctrl) {
+    return writeD16(Register::McstCbltAddr, cbltAddr & McstCblt::AddrMask) &&
+           writeD16(Register::McstCbltCtrl, ctrl);
+}
+
+bool CaenV1290N::join_group(bool join) {
+    if (!join) {
+        groupMember_ = 0;
+        return true;
+    }
+
+    epicsMutexLock(readoutLock_);
+    uint16_t control = 0;
+    if (!readD16(Register::Control, control)) {
+        epicsMutexUnlock(readoutLock_);
         return false;
     }
-    writeD16(Register::Micro, opcode);
 
-    if (!wait_micro_handshake(Handshake::ReadOk)) {
-        printf("read_micro: wait_micro_handshake returned error");
+    // The group sizes every CBLT from the Event FIFO and moves one event per board per cycle.
+    // EmptyEvent makes the board store a header and trailer even for triggers without hits, so
+    // every member holds an event for every trigger and the group never waits on a quiet board.
+    groupMember_ = 1;
+    const uint16_t wanted = (control | Control::EventFifoEn | Control::EmptyEvent) & ~Control::Align64;
+    if (!writeD16(Register::BltEventNumber, 1) || (wanted != control && !writeD16(Register::Control, wanted))) {
+        groupMember_ = 0;
+        epicsMutexUnlock(readoutLock_);
+        return false;
+    }
+    bltEventNumber_ = 1;
+    eventFifo_ = 1;
+    fifoPendingWords_ = 0;
+    fifoPendingEvents_ = 0;
+    epicsMutexUnlock(readoutLock_);
+    return true;
+}
+
+int CaenV1290N::geo_address(int geo) {
+    if (geo && !writeD16(Register::GeoAddr, geo & DataWord::GeoMask)) {
+        return -1;
+    }
+    uint16_t v16 = 0;
+    if (!readD16(Register::GeoAddr, v16)) {
+        return -1;
+    }
+    return v16 & DataWord::GeoMask;
+}
+
+size_t CaenV1290N::events_in_fifo() {
+    uint16_t stored = 0;
+    if (!readD16(Register::EventFifoStored, stored)) {
+        return 0;
+    }
+    return stored & EventFifo::StoredMask;
+}
+
+size_t CaenV1290N::pop_event_fifo() {
+    uint32_t entry = 0;
+    if (!readD32(Register::EventFifo, entry)) {
+        return 0;
+    }
+    return entry & EventFifo::WordCountMask;
+}
+
+bool CaenV1290N::push_words(const uint32_t* words, size_t n, size_t events) {
+    if (ring_.capacity() - ring_.used() < n) {
+        ringStalls_++;
         return false;
     }
-    return readD16(Register::Micro, value);
+
+    size_t done = 0;
+    while (done < n) {
+        size_t space = 0;
+        uint32_t* dst = ring_.reserve(space);
+        const size_t k = (n - done) < space ? (n - done) : space;
+        memcpy(dst, words + done, k * sizeof(uint32_t));
+        ring_.commit(k);
+        done += k;
+    }
+    blockWords_.add(n);
+    wordsRead_ += n;
+    eventsRead_ += events;
+    blocksRead_++;
+    return true;
+}
+
+void CaenV1290N::isr() {
+    // The board holds the IRQ line until the buffer drops below AlmostFullLevel, so mask it
+    // here and let the readout thread re-arm it once drained. The board answered the IACK
+    // cycle, so the unchecked write is safe, and the only kind allowed in interrupt context.
+    bus_->write16_isr(Register::IntLevel, 0);
+    irqArmed_ = 0;
+    irqCount_++;
+    epicsEventSignal(readoutEvent_);
+}
+
+void CaenV1290N::arm_interrupt() {
+    if (intLevel_ && !irqArmed_) {
+        irqArmed_ = 1;
+        if (!writeD16(Register::IntLevel, intLevel_)) {
+            irqArmed_ = 0;
+        }
+    }
+}
+
+void CaenV1290N::wait_for_data() {
+    if (intLevel_) {
+        epicsEventWaitWithTimeout(readoutEvent_, readout_irq_timeout_sec);
+    } else {
+        epicsThreadSleep(readout_idle_sec);
+    }
+}
+
+size_t CaenV1290N::read_block(uint32_t* dst, size_t max_words, size_t& events) {
+    const size_t max_events = bltEventNumber_;
+    size_t n = 0; // words stored in dst
+    size_t i = 0; // words popped from the Output Buffer
+    size_t trailers = 0;
+
+    while (n < max_words) {
+        uint32_t beat[2];
+        size_t width = 1;
+        if (i == 0) {
+            // The first word always goes through the probe so a missing board can't fault the CPU
+            if (!readD32(Register::OutBuf, beat[0])) {
+                break;
+            }
+        } else if (readoutMode_ == ReadoutMode::Mblt64 && (i & 1) == 0 && n + 2 <= max_words) {
+            outbuf_dword(i, beat);
+            width = 2;
+        } else if (readoutMode_ == ReadoutMode::D32) {
+            if (!readD32(Register::OutBuf, beat[0])) {
+                break;
+            }
+        } else {
+            beat[0] = outbuf_word(i);
+        }
+        i += width;
+
+        bool done = false;
+        for (size_t k = 0; k < width && !done; k++) {
+            const uint32_t type = beat[k] >> DataWord::TypeShift;
+            if (type == DataWord::Filler) {
+                // With Align64 a filler following a trailer is padding, anything else means empty
+                const bool pad = k == 1 && (beat[0] >> DataWord::TypeShift) == DataWord::GlobalTrailer;
+                done = !pad;
+                continue;
+            }
+            dst[n++] = beat[k];
+            if (type == DataWord::GlobalTrailer) {
+                trailers++;
+                done = max_events && trailers >= max_events;
+            }
+        }
+        if (done) {
+            break;
+        }
+    }
+
+    events += trailers;
+    return n;
+}
+
+size_t CaenV1290N::transfer_words(uint32_t* dst, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        if (i == 0 || readoutMode_ == ReadoutMode::D32) {
+            if (!readD32(Register::OutBuf, dst[i])) {
+                break;
+            }
+            i++;
+        } else if (readoutMode_ == ReadoutMode::Mblt64 && (i & 1) == 0 && i + 2 <= n) {
+            outbuf_dword(i, dst + i);
+            i += 2;
+        } else {
+            dst[i] = outbuf_word(i);
+            i++;
+        }
+    }
+    return i;
+}
+
+size_t CaenV1290N::read_fifo_block(uint32_t* dst, size_t max_words, size_t& events) {
+    if (fifoPendingWords_ == 0) {
+        uint16_t stored = 0;
+        if (!readD16(Register::EventFifoStored, stored)) {
+            return 0;
+        }
+        size_t nevents = stored & EventFifo::StoredMask;
+        if (bltEventNumber_ && nevents > bltEventNumber_) {
+            nevents = bltEventNumber_;
+        }
+
+        for (size_t k = 0; k < nevents; k++) {
+            uint32_t entry = 0;
+            if (!readD32(Register::EventFifo, entry)) {
+                break;
+            }
+            size_t words = entry & EventFifo::WordCountMask;
+            // Align64 pads odd-sized events with a filler word that the FIFO doesn't count
+            if (readoutMode_ == ReadoutMode::Mblt64 && (words & 1)) {
+                words++;
+            }
+            fifoPendingWords_ += words;
+            fifoPendingEvents_++;
+        }
+    }
+
+    const size_t want = fifoPendingWords_ < max_words ? fifoPendingWords_ : max_words;
+    const size_t n = transfer_words(dst, want);
+    fifoPendingWords_ -= n;
+    if (fifoPendingWords_ == 0) {
+        events += fifoPendingEvents_;
+        fifoPendingEvents_ = 0;
+    }
+    return n;
 }
 
 asynStatus CaenV1290N::writeUInt32Digital(asynUser* pasynUser, epicsUInt32 value, epicsUInt32 mask) {
@@ -128,7 +944,10 @@ asynStatus CaenV1290N::writeUInt32Digital(asynUser* pasynUser, epicsUInt32 value
             asyn_status = asynError;
         }
     } else if (function == controlId_) {
-        if (!writeD16(Register::Control, value)) {
+        // The readout mode owns BerrEn and Align64, and a CBLT group needs the Event FIFO and empty events
+        const uint16_t keep = Control::BerrEn | Control::Align64 |
+                              (groupMember_ ? Control::EventFifoEn | Control::EmptyEvent : 0);
+        if (!write_control(value, keep)) {
             asyn_status = asynError;
         }
     }
@@ -146,7 +965,7 @@ asynStatus CaenV1290N::readUInt32Digital(asynUser* pasynUser, epicsUInt32* value
 
     uint16_t v16 = 0;
     if (function == enablePatternId_) {
-        if (!read_micro(Opcode::ReadEnablePattern, v16)) {
+        if (!read_shadow(Shadow::EnablePattern, v16)) {
             asyn_status = asynError;
         }
         *value = v16;
@@ -172,17 +991,17 @@ asynStatus CaenV1290N::readInt32(asynUser* pasynUser, epicsInt32* value) {
 
     uint16_t v16 = 0;
     if (function == edgeDetectModeId_) {
-        if (!read_micro(Opcode::ReadEdgeDetectionMode, v16)) {
+        if (!read_shadow(Shadow::EdgeDetectMode, v16)) {
             asyn_status = asynError;
         };
         *value = v16;
     } else if (function == acquisitionModeId_) {
-        if (!read_micro(Opcode::ReadAcquisitionMode, v16)) {
+        if (!read_shadow(Shadow::AcquisitionMode, v16)) {
             asyn_status = asynError;
         };
         *value = v16;
     } else if (function == tdcHeaderTrailerId_) {
-        if (!read_micro(Opcode::TDCHeaderTrailerStatus, v16)) {
+        if (!read_shadow(Shadow::HeaderTrailer, v16)) {
             asyn_status = asynError;
         };
         *value = v16;
@@ -249,59 +1068,225 @@ asynStatus CaenV1290N::writeInt32(asynUser* pasynUser, epicsInt32 value) {
             asyn_status = asynError;
         }
     } else if (function == dummy16Id_) {
+        uint16_t readback = 0;
         if (!writeD16(Register::Dummy16, value)) {
             printf("Write to dummy16 register failed\n");
             asyn_status = asynError;
         } else {
             printf("Wrote %d to dummy16 register\n", value);
         }
+        // The Dummy poll group is off by default, so read back on demand
+        if (readD16(Register::Dummy16, readback)) {
+            setIntegerParam(dummy16Id_, readback);
+            callParamCallbacks();
+        }
     } else if (function == dummy32Id_) {
+        uint32_t readback = 0;
         if (!writeD32(Register::Dummy32, value)) {
             printf("Write to dummy32 register failed\n");
             asyn_status = asynError;
         } else {
             printf("Wrote %d to dummy32 register\n", value);
         }
-    } else if (function == testregId_) {
-        if (writeD32(Register::TestReg, value)) {
-            printf("Wrote 0x%X to test register\n", value);
+        if (readD32(Register::Dummy32, readback)) {
+            setIntegerParam(dummy32Id_, readback);
+            callParamCallbacks();
+        }
+    } else if (function == readoutEnableId_) {
+        readoutEnable_ = value ? 1 : 0;
+        setIntegerParam(readoutEnableId_, readoutEnable_);
+    } else if (function == readoutModeId_) {
+        // Waits for the block transfer in progress, which must finish in the mode it started in
+        epicsMutexLock(readoutLock_);
+        const bool ok = value >= ReadoutMode::D32 && value <= ReadoutMode::Mblt64 && configure_readout(value);
+        if (ok) {
+            readoutMode_ = value;
+        }
+        epicsMutexUnlock(readoutLock_);
+        if (!ok) {
+            asyn_status = asynError;
         } else {
-            printf("Error writing 0x%X to test register\n", value);
+            setIntegerParam(readoutModeId_, value);
+        }
+    } else if (function == bltEventNumberId_) {
+        // The readout thread sizes its transfers from bltEventNumber_, so change it between transfers
+        epicsMutexLock(readoutLock_);
+        bool ok = !groupMember_ || value == 1;
+        if (!ok) {
+            // The group moves exactly one event per board per CBLT cycle
+            printf("BLT event number must stay 1 while the board is in a CBLT group\n");
+        } else if (!writeD16(Register::BltEventNumber, value)) {
+            printf("Write to BLT event number register failed\n");
+            ok = false;
+        } else {
+            bltEventNumber_ = value;
+        }
+        epicsMutexUnlock(readoutLock_);
+        if (!ok) {
             asyn_status = asynError;
+        } else {
+            setIntegerParam(bltEventNumberId_, value);
         }
-    }
-
-    // Output Buffer test using TEST_FIFO mode (see manual section 6.22)
-    // When TEST_FIFO is enabled in the Control Register, writing a D32 word
-    // to the Testreg (0x1028) loads it into the Output Buffer for readback.
-    else if (function == devParamId_) {
-        const uint32_t testPatterns[] = {0xDEADBEEF, 0x12345678, 0x00000000, 0xFFFFFFFF};
-        const int numPatterns = sizeof(testPatterns) / sizeof(testPatterns[0]);
-        int passed = 0;
-
-        // 1. Read current Control register value
-        uint16_t savedControl = 0;
-        if (!readD16(Register::Control, savedControl)) {
-            printf("TEST_FIFO: failed to read Control register\n");
+    } else if (function == eventFifoEnableId_) {
+        if (!value && groupMember_) {
+            // The group sizes every CBLT from the Event FIFO
+            printf("Event FIFO cannot be disabled while the board is in a CBLT group\n");
+            asyn_status = asynError;
+        } else if (!write_control(value ? Control::EventFifoEn : 0, (uint16_t)~Control::EventFifoEn)) {
             asyn_status = asynError;
-            goto test_done;
         }
-
-        // 2. Enable TEST_FIFO bit in Control register
-        // NOTE: writing to Control also triggers a module CLEAR (manual Table 4.2),
-        // which clears the output buffer for us, so no separate SwClear needed.
-        if (!writeD16(Register::Control, savedControl | Control::TestFifoEnable)) {
-            printf("TEST_FIFO: failed to enable TEST_FIFO in Control register\n");
+    } else if (function == histMinId_ || function == histBinWidthId_ || function == histNbinsId_) {
+        if (value < 0 || (function == histBinWidthId_ && value < 1) ||
+            (function == histNbinsId_ && (value < 1 || value > MAX_HIST_BINS))) {
             asyn_status = asynError;
-            goto test_restore;
+        } else {
+            setIntegerParam(function, value);
+            histDirty_ = 1;
         }
-        printf("TEST_FIFO: enabled (Control = 0x%04X)\n", savedControl | Control::TestFifoEnable);
-
-        // Allow board to settle after CLEAR triggered by Control write
-        epicsThreadSleep(0.1);
-
-        // Diagnostic: verify Control readback confirms TEST_FIFO is set
-        {
+    } else if (function == filterChannelsId_ || function == filterEdgesId_ || function == filterTimeWindowId_ ||
+               function == filterTimeMinId_ || function == filterTimeMaxId_ || function == filterMinHitsId_ ||
+               function == filterMaxHitsId_ || function == filterDropEmptyId_) {
+        if ((function == filterChannelsId_ && (value & ~0xFFFF)) ||
+            (function == filterEdgesId_ && (value & ~(int)FilterEdge::Both)) ||
+            ((function == filterMinHitsId_ || function == filterMaxHitsId_) && value < 0)) {
+            asyn_status = asynError;
+        } else {
+            setIntegerParam(function, value);
+            filterDirty_ = 1;
+        }
+    } else if (function == totHistMinId_ || function == totHistBinWidthId_ || function == totHistNbinsId_) {
+        if (value < 0 || (function == totHistBinWidthId_ && value < 1) ||
+            (function == totHistNbinsId_ && (value < 1 || value > MAX_HIST_BINS))) {
+            asyn_status = asynError;
+        } else {
+            setIntegerParam(function, value);
+            totDirty_ = 1;
+        }
+    } else if (function == fileEnableId_) {
+        fileEnable_ = value ? 1 : 0;
+        setIntegerParam(fileEnableId_, fileEnable_);
+    } else if (function == replayLoopId_) {
+        replayLoop_ = value ? 1 : 0;
+        setIntegerParam(replayLoopId_, replayLoop_);
+    } else if (function == replayRestartId_) {
+        replayRestart_ = 1;
+    } else if (function == statsResetId_) {
+        // The histograms tolerate a clear racing their writer, the counters are only statistics
+        for (int s = 0; s < Stage::Count; s++) {
+            latency_[s].clear();
+        }
+        blockWords_.clear();
+        almostFullCount_ = 0;
+        fullCount_ = 0;
+        triggerLostCount_ = 0;
+        epicsAtomicSetSizeT(&eventsTriggerLost_, 0);
+        epicsAtomicSetSizeT(&eventsOverflow_, 0);
+        eventsStoredPeak_ = 0;
+    } else if (function == fileFormatId_) {
+        // Takes effect when the next recording starts
+        if (value != (int)FileFormat::Raw && value != (int)FileFormat::Columnar) {
+            asyn_status = asynError;
+        } else {
+            setIntegerParam(fileFormatId_, value);
+        }
+    } else if (function == microSpinUsId_) {
+        if (value < 0 || value > 100000) {
+            asyn_status = asynError;
+        } else {
+            microSpinUs_ = value;
+            setIntegerParam(microSpinUsId_, value);
+        }
+    } else if (function == fileSegmentSizeId_) {
+        if (value < 1 || value > 4095) {
+            asyn_status = asynError;
+        } else {
+            setIntegerParam(fileSegmentSizeId_, value);
+        }
+    } else if (function == coincStartId_ || function == coincStopsId_ || function == coincWindowMinId_ ||
+               function == coincWindowMaxId_ || function == coincHistMinId_ || function == coincHistBinWidthId_ ||
+               function == coincHistNbinsId_) {
+        int addr = 0, windowMin = 0, windowMax = 0;
+        getAddress(pasynUser, &addr);
+        if (addr >= 0 && addr < MAX_COINCIDENCES) {
+            getIntegerParam(addr, coincWindowMinId_, &windowMin);
+            getIntegerParam(addr, coincWindowMaxId_, &windowMax);
+        }
+        // An inverted window would silently never match
+        if (addr < 0 || addr >= MAX_COINCIDENCES || (function == coincStartId_ && value >= MAX_CHANNELS) ||
+            (function == coincStopsId_ && (value < 0 || value > 0xFFFF)) ||
+            (function == coincWindowMinId_ && value > windowMax) ||
+            (function == coincWindowMaxId_ && value < windowMin) ||
+            (function == coincHistBinWidthId_ && value < 1) ||
+            (function == coincHistNbinsId_ && (value < 1 || value > MAX_HIST_BINS))) {
+            asyn_status = asynError;
+        } else {
+            setIntegerParam(addr, function, value);
+            callParamCallbacks(addr);
+            coincDirty_[addr] = 1;
+        }
+    } else if (function == exportEnableId_) {
+        exportEnable_ = value != 0;
+        setIntegerParam(exportEnableId_, exportEnable_);
+    } else if (function == coincResetId_) {
+        for (int slot = 0; slot < MAX_COINCIDENCES; slot++) {
+            coincDirty_[slot] = 1;
+        }
+    } else if (function == histResetId_) {
+        histDirty_ = 1;
+        totDirty_ = 1;
+    } else if (function == shadowResyncId_) {
+        if (!resync_shadow()) {
+            asyn_status = asynError;
+        }
+        setIntegerParam(shadowMismatchesId_, (epicsInt32)shadowMismatches_);
+        callParamCallbacks();
+    } else if (function == almostFullLevelId_) {
+        if (value < 1 || value > OUTBUF_MAX_WORDS || !writeD16(Register::AlmostFullLevel, value)) {
+            printf("Write to almost full level register failed\n");
+            asyn_status = asynError;
+        } else {
+            setIntegerParam(almostFullLevelId_, value);
+        }
+    } else if (function == testregId_) {
+        if (writeD32(Register::TestReg, value)) {
+            printf("Wrote 0x%X to test register\n", value);
+        } else {
+            printf("Error writing 0x%X to test register\n", value);
+            asyn_status = asynError;
+        }
+    }
+
+    // Output Buffer test using TEST_FIFO mode (see manual section 6.22)
+    // When TEST_FIFO is enabled in the Control Register, writing a D32 word
+    // to the Testreg (0x1028) loads it into the Output Buffer for readback.
+    else if (function == devParamId_) {
+        const uint32_t testPatterns[] = {0xDEADBEEF, 0x12345678, 0x00000000, 0xFFFFFFFF};
+        const int numPatterns = sizeof(testPatterns) / sizeof(testPatterns[0]);
+        int passed = 0;
+
+        // 1. Read current Control register value
+        uint16_t savedControl = 0;
+        if (!readD16(Register::Control, savedControl)) {
+            printf("TEST_FIFO: failed to read Control register\n");
+            asyn_status = asynError;
+            goto test_done;
+        }
+
+        // 2. Enable TEST_FIFO bit in Control register
+        // NOTE: writing to Control also triggers a module CLEAR (manual Table 4.2),
+        // which clears the output buffer for us, so no separate SwClear needed.
+        if (!writeD16(Register::Control, savedControl | Control::TestFifoEnable)) {
+            printf("TEST_FIFO: failed to enable TEST_FIFO in Control register\n");
+            asyn_status = asynError;
+            goto test_restore;
+        }
+        printf("TEST_FIFO: enabled (Control = 0x%04X)\n", savedControl | Control::TestFifoEnable);
+
+        // Allow board to settle after CLEAR triggered by Control write
+        epicsThreadSleep(0.1);
+
+        // Diagnostic: verify Control readback confirms TEST_FIFO is set
+        {
             uint16_t controlReadback = 0;
             readD16(Register::Control, controlReadback);
             printf("TEST_FIFO: Control readback = 0x%04X (TEST_FIFO bit %s)\n",
@@ -398,10 +1383,6 @@ asynStatus CaenV1290N::writeInt32(asynUser* pasynUser, epicsInt32 value) {
                    ok ? "OK" : "FAIL", readback);
         }
 
-        // Print the local (CPU) address for reference
-        printf("TEST_FIFO: base ptr = %p, OutBuf addr = %p, Testreg addr = %p\n",
-               (void*)base, (void*)(base + Register::OutBuf), (void*)(base + Register::TestReg));
-
         printf("TEST_FIFO: %d/%d patterns passed\n", passed, numPatterns);
 
 test_restore:
@@ -413,62 +1394,1044 @@ test_done:
     }
 
     if (asyn_status) {
-        asynPrint(pasynUser, ASYN_TRACE_ERROR, "Error in CaenV1290N::readInt32\n");
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "Error in CaenV1290N::writeInt32\n");
     }
 
-    return asynSuccess;
+    return asyn_status;
+}
+
+void CaenV1290N::update_rates(double t) {
+    size_t counts[RateCounter::Count];
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        counts[ch] = epicsAtomicGetSizeT(&channelHits_[ch]);
+    }
+    counts[RateCounter::Hits] = epicsAtomicGetSizeT(&hitsDecoded_);
+    counts[RateCounter::Events] = epicsAtomicGetSizeT(&eventsDecoded_);
+    counts[RateCounter::Triggers] = triggerCount_;
+    rates_.sample(t, counts);
+
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        setIntegerParam(ch, channelHitsId_, (epicsInt32)counts[ch]);
+        setDoubleParam(ch, channelRateId_, rates_.rate(ch));
+        if (ch > 0) {
+            callParamCallbacks(ch);
+        }
+    }
+    setIntegerParam(triggerCountId_, (epicsInt32)triggerCount_);
+    setDoubleParam(triggerRateId_, rates_.rate(RateCounter::Triggers));
+    setDoubleParam(hitRateId_, rates_.rate(RateCounter::Hits));
+    setDoubleParam(eventRateId_, rates_.rate(RateCounter::Events));
 }
 
 void CaenV1290N::poll() {
+    epicsTimeStamp start, now, lastRates, lastVerify;
+    epicsTimeGetCurrent(&start);
+    lastRates = lastVerify = start;
+
+    // When each group is next due, in seconds since start
+    double due[PollGroup::Count] = {0};
+
     while (true) {
-        uint16_t val16 = 0;
-        uint32_t val32 = 0;
+        epicsTimeGetCurrent(&now);
+        const double t = epicsTimeDiffInSeconds(&now, &start);
 
-        lock();
+        // Groups are serviced in priority order, Status first
+        double next = t + poll_max_sleep_sec;
+        for (int group = 0; group < PollGroup::Count; group++) {
+            double period = pollPeriod_[group];
+            if (group == PollGroup::Status && t < pollFastUntil_ && (period <= 0 || pollFastPeriod_ < period)) {
+                period = pollFastPeriod_;
+            }
+            if (period <= 0) {
+                continue;
+            }
+            if (t >= due[group]) {
+                poll_group(group, t);
+                due[group] = t + period;
+            }
+            next = due[group] < next ? due[group] : next;
+        }
+
+        // Catch settings changed behind the driver's back, e.g. by a power cycle or another IOC,
+        // and refresh them right away after a configuration load
+        if (shadowResyncDue_ ||
+            (shadowVerifyPeriod_ > 0 && epicsTimeDiffInSeconds(&now, &lastVerify) >= shadowVerifyPeriod_)) {
+            lastVerify = now;
+            shadowResyncDue_ = 0;
+            resync_shadow();
+            lock();
+            setIntegerParam(shadowMismatchesId_, (epicsInt32)shadowMismatches_);
+            callParamCallbacks();
+            unlock();
+        }
+
+        if (epicsTimeDiffInSeconds(&now, &lastRates) >= ratePeriod_) {
+            lastRates = now;
+            lock();
+            update_rates(t);
+            callParamCallbacks();
+            unlock();
+        }
+        const double rates_due = epicsTimeDiffInSeconds(&lastRates, &start) + ratePeriod_;
+        next = rates_due < next ? rates_due : next;
 
-        // Read status register
-        val16 = 0;
-        if (readD16(Register::Status, val16)) {
+        epicsTimeGetCurrent(&now);
+        const double sleep = next - epicsTimeDiffInSeconds(&now, &start);
+        epicsThreadSleep(sleep > 0 ? sleep : 0);
+    }
+}
+
+void CaenV1290N::poll_group(int group, double t) {
+    uint16_t val16 = 0;
+    uint32_t val32 = 0;
+
+    if (group == PollGroup::Status) {
+        // Bus reads happen outside the port lock so they don't hold up writes and readbacks
+        const bool status_ok = readD16(Register::Status, val16);
+        uint16_t stored = 0;
+        const bool stored_ok = readD16(Register::EventStored, stored);
+        const bool counter_ok = readD32(Register::EventCounter, val32);
+
+        if (status_ok && (val16 & (Status::AlmostFull | Status::Full | Status::TriggerLost))) {
+            pollFastUntil_ = t + pollFastHold_;
+        }
+        lock();
+        if (status_ok) {
             setUIntDigitalParam(statusId_, val16, 0xFFFF);
         }
+        // The fast poll would repeat the same message many times a second, so only the change is
+        // printed and the records go into alarm for as long as the reads fail
+        if (stored_ok) {
+            if (storedFailures_) {
+                printf("CaenV1290N: EventStored readable again after %lu failed reads\n",
+                       (unsigned long)storedFailures_);
+                storedFailures_ = 0;
+            }
+            eventsStoredPeak_ = stored > eventsStoredPeak_ ? stored : eventsStoredPeak_;
+            setIntegerParam(eventsStoredId_, stored);
+            setIntegerParam(eventsStoredPeakId_, eventsStoredPeak_);
+        } else if (storedFailures_++ == 0) {
+            printf("CaenV1290N: failure reading EventStored\n");
+        }
+        setParamStatus(eventsStoredId_, stored_ok ? asynSuccess : asynError);
+        if (counter_ok) {
+            // The counter restarts from zero after a module clear
+            triggerCount_ += val32 >= lastEventCounter_ ? val32 - lastEventCounter_ : val32;
+            lastEventCounter_ = val32;
+            setIntegerParam(triggerCountId_, (epicsInt32)triggerCount_);
+        }
+        setIntegerParam(pollFastId_, t < pollFastUntil_);
+        callParamCallbacks();
+        unlock();
+    } else if (group == PollGroup::Counters) {
+        lock();
+        setIntegerParam(wordsReadId_, (epicsInt32)wordsRead_);
+        setIntegerParam(eventsReadId_, (epicsInt32)eventsRead_);
+        setIntegerParam(blocksReadId_, (epicsInt32)blocksRead_);
+        setIntegerParam(ringUsedId_, (epicsInt32)ring_.used());
+        setIntegerParam(ringStallsId_, (epicsInt32)ringStalls_);
+        setIntegerParam(hitsDecodedId_, (epicsInt32)epicsAtomicGetSizeT(&hitsDecoded_));
+        setIntegerParam(eventsDecodedId_, (epicsInt32)epicsAtomicGetSizeT(&eventsDecoded_));
+        setIntegerParam(unknownWordsId_, (epicsInt32)decoder_.unknown_words());
+        if (replay_) {
+            setIntegerParam(replaySegmentId_, replay_->segment());
+            setIntegerParam(replayDoneId_, replayDone_);
+        }
+        setIntegerParam(filterHitsDroppedId_, (epicsInt32)filter_.hits_dropped());
+        setIntegerParam(filterEventsDroppedId_, (epicsInt32)filter_.events_dropped());
+        setIntegerParam(irqCountId_, (epicsInt32)irqCount_);
+        setIntegerParam(microErrorsId_, (epicsInt32)microErrors_);
+        setIntegerParam(exportSequenceId_, (epicsInt32)epicsAtomicGetSizeT(&exportSequence_));
+        setIntegerParam(exportDroppedId_, (epicsInt32)epicsAtomicGetSizeT(&exportDropped_));
+        setIntegerParam(fileSegmentId_, fileWriter_.segment());
+        setDoubleParam(fileBytesWrittenId_, fileWriter_.bytes_written());
+        setIntegerParam(fileBatchesDroppedId_, (epicsInt32)epicsAtomicGetSizeT(&fileDropped_));
+        setIntegerParam(almostFullCountId_, (epicsInt32)almostFullCount_);
+        setIntegerParam(fullCountId_, (epicsInt32)fullCount_);
+        setIntegerParam(triggerLostCountId_, (epicsInt32)triggerLostCount_);
+        setIntegerParam(eventsTriggerLostId_, (epicsInt32)epicsAtomicGetSizeT(&eventsTriggerLost_));
+        setIntegerParam(eventsOverflowId_, (epicsInt32)epicsAtomicGetSizeT(&eventsOverflow_));
+        setDoubleParam(blockWordsMeanId_, blockWords_.mean());
+        setIntegerParam(blockWordsMaxId_, (epicsInt32)blockWords_.max());
+        callParamCallbacks();
+        // Durations are published in microseconds, one address per Stage
+        for (int s = 0; s < Stage::Count; s++) {
+            const LatencyHistogram& h = latency_[s];
+            setIntegerParam(s, stageCountId_, (epicsInt32)h.count());
+            setDoubleParam(s, stageMeanId_, h.mean() * 1e-3);
+            setDoubleParam(s, stageP50Id_, h.percentile(0.5) * 1e-3);
+            setDoubleParam(s, stageP99Id_, h.percentile(0.99) * 1e-3);
+            setDoubleParam(s, stageMaxId_, h.max() * 1e-3);
+            callParamCallbacks(s);
+        }
+        unlock();
+    } else if (group == PollGroup::Dummy) {
+        const bool ok16 = readD16(Register::Dummy16, val16);
+        const bool ok32 = readD32(Register::Dummy32, val32);
+        lock();
+        if (ok16) {
+            setIntegerParam(dummy16Id_, val16);
+        }
+        if (ok32) {
+            setIntegerParam(dummy32Id_, val32);
+        }
+        callParamCallbacks();
+        unlock();
+    }
+}
+
+void CaenV1290N::readout() {
+    while (true) {
+        if (!readoutEnable_ || groupMember_) {
+            wait_for_data();
+            continue;
+        }
+        if (replay_) {
+            replay_block();
+            continue;
+        }
+
+        // Held from the Status check to the commit, released before any wait
+        epicsMutexLock(readoutLock_);
+        if (fifoPendingWords_ == 0) {
+            uint16_t status = 0;
+            const bool status_ok = readD16(Register::Status, status);
+            if (status_ok) {
+                note_status(status);
+            }
+            if (!status_ok || !(status & Status::DataReady)) {
+                epicsMutexUnlock(readoutLock_);
+                arm_interrupt();
+                wait_for_data();
+                continue;
+            }
+        }
+
+        // Read straight into the ring. If the slowest consumer hasn't freed any space, leave the
+        // data on the board rather than overwrite unread words.
+        size_t space = 0;
+        uint32_t* dst = ring_.reserve(space);
+        if (space == 0) {
+            epicsMutexUnlock(readoutLock_);
+            ringStalls_++;
+            epicsThreadSleep(readout_idle_sec);
+            continue;
+        }
+
+        size_t events = 0;
+        const epicsUInt64 t0 = epicsMonotonicGet();
+        // Continuous mode stores no events, so there's nothing in the Event FIFO to size blocks by
+        const bool fifo = eventFifo_ && (!continuous_ || fifoPendingWords_);
+        const size_t n = fifo ? read_fifo_block(dst, space, events) : read_block(dst, space, events);
+        epicsMutexUnlock(readoutLock_);
+        if (n > 0) {
+            ring_.commit(n);
+            latency_[Stage::Readout].add(epicsMonotonicGet() - t0);
+            blockWords_.add(n);
+            wordsRead_ += n;
+            eventsRead_ += events;
+            blocksRead_++;
+        } else {
+            // Data ready but nothing transferred, e.g. the Event FIFO hasn't caught up yet
+            wait_for_data();
+        }
+    }
+}
+
+void CaenV1290N::set_replay(double speed, bool loop) {
+    lock();
+    replaySpeed_ = speed > 0 ? speed : 0;
+    replayLoop_ = loop ? 1 : 0;
+    setDoubleParam(replaySpeedId_, replaySpeed_);
+    setIntegerParam(replayLoopId_, replayLoop_);
+    callParamCallbacks();
+    unlock();
+}
+
+void CaenV1290N::replay_block() {
+    if (replayRestart_) {
+        replayRestart_ = 0;
+        replayLeft_ = 0;
+        replayDone_ = 0;
+        replayPaced_ = false;
+        replay_->rewind();
+        // Counters start over with the recording, so the decoder's unwrapping has to as well.
+        // This thread fills the ring, so the boundary falls exactly between the two passes.
+        frames_changed();
+    }
+
+    if (replayLeft_ == 0) {
+        epicsTimeStamp ts;
+        if (!replay_->next_block(replayNext_, replayLeft_, ts)) {
+            replayLeft_ = 0;
+            if (replayLoop_ && replay_->rewind()) {
+                replayPaced_ = false;
+                frames_changed();
+                return;
+            }
+            replayDone_ = 1;
+            epicsThreadSleep(readout_idle_sec);
+            return;
+        }
+
+        // Also covers a recording whose mode changed from one segment to the next
+        if (replay_->has_settings() &&
+            (!replaySettingsKnown_ ||
+             memcmp(&replay_->header().settings, &replaySettings_, sizeof(replaySettings_)) != 0)) {
+            apply_recorded_settings(replay_->header().settings);
+        }
+
+        const double speed = replaySpeed_;
+        const epicsUInt64 now = epicsMonotonicGet();
+        if (speed <= 0 || !replayPaced_) {
+            replayPaced_ = speed > 0;
+            replayBaseTime_ = ts;
+            replayBaseMono_ = now;
+        } else {
+            const double due = epicsTimeDiffInSeconds(&ts, &replayBaseTime_) / speed;
+            const double wait = due - (now - replayBaseMono_) * 1e-9;
+            if (wait > replay_max_gap_sec) {
+                // Skip the pause, later blocks keep their spacing from here
+                replayBaseTime_ = ts;
+                replayBaseMono_ = now;
+            } else if (wait > 0) {
+                epicsThreadSleep(wait);
+            }
+        }
+    }
+
+    size_t space = 0;
+    uint32_t* dst = ring_.reserve(space);
+    if (space == 0) {
+        ringStalls_++;
+        epicsThreadSleep(readout_idle_sec);
+        return;
+    }
+
+    const epicsUInt64 t0 = epicsMonotonicGet();
+    const size_t n = replayLeft_ < space ? replayLeft_ : space;
+    size_t events = 0;
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = replayNext_[i];
+        events += (dst[i] >> DataWord::TypeShift) == DataWord::GlobalTrailer;
+    }
+    ring_.commit(n);
+    latency_[Stage::Readout].add(epicsMonotonicGet() - t0);
+    replayNext_ += n;
+    replayLeft_ -= n;
+    wordsRead_ += n;
+    eventsRead_ += events;
+    if (replayLeft_ == 0) {
+        blocksRead_++;
+    }
+}
+
+void CaenV1290N::apply_recorded_settings(const RecordedSettings& settings) {
+    MicroBatch batch;
+    batch.write(settings.acquisition_mode ? Opcode::SetTriggerMatch : Opcode::SetContinuous);
+    batch.write(Opcode::SetEdgeDetectionMode, (uint16_t)settings.edge_mode);
+    batch.write(Opcode::SetEdgeResolution, (uint16_t)settings.resolution);
+    batch.write(settings.trigger_subtraction ? Opcode::EnableTriggerSubtraction : Opcode::DisableTriggerSubtraction);
+    if (!run_micro(batch)) {
+        printf("CaenV1290N::replay: cannot apply the recorded settings of segment %d\n", replay_->segment());
+    }
+    replaySettings_ = settings;
+    replaySettingsKnown_ = true;
+
+    const uint32_t ticks = settings.frame_ticks;
+    if (ticks > 0 && ticks <= (uint32_t)(max_frame_duration_sec / frame_tick_sec + 0.5) && ticks != frameTicks_) {
+        frameTicks_ = ticks;
+        frames_changed();
+        lock();
+        setDoubleParam(frameDurationId_, frameTicks_ * frame_tick_sec);
+        callParamCallbacks();
+        unlock();
+    }
+}
+
+bool CaenV1290N::recorded_settings(RecordedSettings& settings) {
+    uint16_t v16[4] = {0};
+    const int fields[4] = {Shadow::AcquisitionMode, Shadow::EdgeDetectMode, Shadow::Resolution,
+                           Shadow::TriggerSubtraction};
+    for (int i = 0; i < 4; i++) {
+        if (!read_shadow(fields[i], v16[i])) {
+            return false;
+        }
+    }
+    settings.acquisition_mode = v16[0] & 1;
+    settings.edge_mode = v16[1] & 0x3;
+    settings.resolution = v16[2] & 0x3;
+    settings.trigger_subtraction = v16[3] & 1;
+    settings.frame_ticks = frameTicks_;
+    return true;
+}
+
+void CaenV1290N::note_status(uint16_t status) {
+    const uint16_t rising = status & ~lastStatus_;
+    lastStatus_ = status;
+    almostFullCount_ += (rising & Status::AlmostFull) != 0;
+    fullCount_ += (rising & Status::Full) != 0;
+    triggerLostCount_ += (rising & Status::TriggerLost) != 0;
+
+    if (status & Status::AlmostFull) {
+        if (almostFullSince_ == 0) {
+            almostFullSince_ = epicsMonotonicGet();
+        }
+    } else if (almostFullSince_ != 0) {
+        latency_[Stage::Drain].add(epicsMonotonicGet() - almostFullSince_);
+        almostFullSince_ = 0;
+    }
+}
+
+asynStatus CaenV1290N::writeFloat64(asynUser* pasynUser, epicsFloat64 value) {
+    const int function = pasynUser->reason;
+    asynStatus asyn_status = asynSuccess;
+
+    if (function == histPeriodId_) {
+        if (value <= 0) {
+            asyn_status = asynError;
+        } else {
+            histPeriod_ = value;
+            setDoubleParam(histPeriodId_, value);
+        }
+    } else if (function == replaySpeedId_) {
+        if (value < 0) {
+            asyn_status = asynError;
+        } else {
+            replaySpeed_ = value;
+            setDoubleParam(replaySpeedId_, value);
+        }
+    } else if (function == rateWindowId_) {
+        if (value <= 0) {
+            asyn_status = asynError;
+        } else {
+            rates_.set_window(value);
+            setDoubleParam(rateWindowId_, value);
+        }
+    } else if (function == ratePeriodId_) {
+        if (value <= 0) {
+            asyn_status = asynError;
+        } else {
+            ratePeriod_ = value;
+            setDoubleParam(ratePeriodId_, value);
+        }
+    } else if (function == frameDurationId_) {
+        if (value < frame_tick_sec || value > max_frame_duration_sec) {
+            asyn_status = asynError;
+        } else {
+            frameTicks_ = (uint32_t)(value / frame_tick_sec + 0.5);
+            frames_changed();
+            setDoubleParam(frameDurationId_, frameTicks_ * frame_tick_sec);
+        }
+    } else if (function == pollPeriodId_) {
+        int addr = 0;
+        getAddress(pasynUser, &addr);
+        if (addr < 0 || addr >= PollGroup::Count || value < 0) {
+            asyn_status = asynError;
+        } else {
+            pollPeriod_[addr] = value;
+            setDoubleParam(addr, pollPeriodId_, value);
+            callParamCallbacks(addr);
+        }
+    } else if (function == pollFastPeriodId_) {
+        if (value <= 0) {
+            asyn_status = asynError;
+        } else {
+            pollFastPeriod_ = value;
+            setDoubleParam(pollFastPeriodId_, value);
+        }
+    } else if (function == pollFastHoldId_) {
+        if (value < 0) {
+            asyn_status = asynError;
+        } else {
+            pollFastHold_ = value;
+            setDoubleParam(pollFastHoldId_, value);
+        }
+    } else if (function == shadowVerifyPeriodId_) {
+        if (value < 0) {
+            asyn_status = asynError;
+        } else {
+            shadowVerifyPeriod_ = value;
+            setDoubleParam(shadowVerifyPeriodId_, value);
+        }
+    } else {
+        asyn_status = asynPortDriver::writeFloat64(pasynUser, value);
+    }
+
+    if (asyn_status) {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "Error in CaenV1290N::writeFloat64\n");
+    }
+
+    return asyn_status;
+}
+
+asynStatus CaenV1290N::readInt32Array(asynUser* pasynUser, epicsInt32* value, size_t nElements, size_t* nIn) {
+    const int function = pasynUser->reason;
+    int addr = 0;
+    getAddress(pasynUser, &addr);
+
+    if ((function == histLeadingId_ || function == histTrailingId_) && addr >= 0 && addr < MAX_CHANNELS) {
+        const size_t n = hist_->nbins() < nElements ? hist_->nbins() : nElements;
+        memcpy(value, hist_->counts(addr, function == histTrailingId_ ? Edge::Trailing : Edge::Leading),
+               n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == totHistId_ && addr >= 0 && addr < MAX_CHANNELS) {
+        const size_t n = tot_->nbins() < nElements ? tot_->nbins() : nElements;
+        memcpy(value, tot_->counts(addr, Edge::Leading), n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == coincHistId_ && addr >= 0 && addr < MAX_COINCIDENCES) {
+        const size_t n = coinc_->nbins(addr) < nElements ? coinc_->nbins(addr) : nElements;
+        memcpy(value, coinc_->counts(addr), n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if ((function == stageHistId_ && addr >= 0 && addr < Stage::Count) || function == blockWordsHistId_) {
+        const LatencyHistogram& h = function == blockWordsHistId_ ? blockWords_ : latency_[addr];
+        const size_t n = nElements < (size_t)LATENCY_BUCKETS ? nElements : LATENCY_BUCKETS;
+        for (size_t b = 0; b < n; b++) {
+            const size_t count = h.bucket(b);
+            value[b] = count > 0x7FFFFFFF ? 0x7FFFFFFF : (epicsInt32)count;
+        }
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == configId_) {
+        TdcConfig config;
+        if (!snapshot_config(config)) {
+            return asynError;
+        }
+        const size_t n = nElements < (size_t)TdcConfigWord::Count ? nElements : TdcConfigWord::Count;
+        for (size_t i = 0; i < n; i++) {
+            // The window offset is signed, every other word is not
+            value[i] = i == (size_t)TdcConfigWord::WindowOffset ? (epicsInt16)config.words[i] : config.words[i];
+        }
+        *nIn = n;
+        return asynSuccess;
+    }
+    return asynPortDriver::readInt32Array(pasynUser, value, nElements, nIn);
+}
+
+asynStatus CaenV1290N::writeInt32Array(asynUser* pasynUser, epicsInt32* value, size_t nElements) {
+    const int function = pasynUser->reason;
+
+    if (function != configId_) {
+        return asynPortDriver::writeInt32Array(pasynUser, value, nElements);
+    }
+    if (nElements != (size_t)TdcConfigWord::Count) {
+        printf("CaenV1290N: configuration needs %d words, got %d\n", TdcConfigWord::Count, (int)nElements);
+        return asynError;
+    }
+
+    // Check everything before touching the board
+    TdcConfig config;
+    for (int i = 0; i < TdcConfigWord::Count; i++) {
+        if (value[i] < -32768 || value[i] > 0xFFFF) {
+            printf("CaenV1290N: configuration word %d out of range: %d\n", i, value[i]);
+            return asynError;
+        }
+        config.words[i] = (uint16_t)value[i];
+    }
+    const int bad = tdc_config_validate(config);
+    if (bad >= 0) {
+        printf("CaenV1290N: configuration word %d out of range: %d\n", bad, value[bad]);
+        return asynError;
+    }
+
+    if (!apply_config(config)) {
+        return asynError;
+    }
+    config_ = config;
+    setIntegerParam(windowWidthId_, config.words[TdcConfigWord::WindowWidth]);
+    setIntegerParam(windowOffsetId_, (epicsInt16)config.words[TdcConfigWord::WindowOffset]);
+    callParamCallbacks();
+    return asynSuccess;
+}
+
+asynStatus CaenV1290N::readFloat64Array(asynUser* pasynUser, epicsFloat64* value, size_t nElements,
+                                        size_t* nIn) {
+    const int function = pasynUser->reason;
+
+    if (function == histAxisId_) {
+        const size_t n = hist_->nbins() < nElements ? hist_->nbins() : nElements;
+        memcpy(value, histAxis_, n * sizeof(epicsFloat64));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == totHistAxisId_) {
+        const size_t n = tot_->nbins() < nElements ? tot_->nbins() : nElements;
+        memcpy(value, totAxis_, n * sizeof(epicsFloat64));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == stageAxisId_ || function == blockWordsAxisId_) {
+        // Stage buckets in microseconds, block size buckets in words
+        const double scale = function == stageAxisId_ ? 1e-3 : 1.0;
+        const size_t n = nElements < (size_t)LATENCY_BUCKETS ? nElements : LATENCY_BUCKETS;
+        for (size_t b = 0; b < n; b++) {
+            value[b] = LatencyHistogram::upper_edge(b) * scale;
+        }
+        *nIn = n;
+        return asynSuccess;
+    }
+    int addr = 0;
+    getAddress(pasynUser, &addr);
+    if (function == coincAxisId_ && addr >= 0 && addr < MAX_COINCIDENCES) {
+        const size_t n = coinc_->nbins(addr) < nElements ? coinc_->nbins(addr) : nElements;
+        memcpy(value, coincAxis_ + addr * MAX_HIST_BINS, n * sizeof(epicsFloat64));
+        *nIn = n;
+        return asynSuccess;
+    }
+    return asynPortDriver::readFloat64Array(pasynUser, value, nElements, nIn);
+}
+
+void CaenV1290N::update_coincidences(bool publish) {
+    for (int slot = 0; slot < MAX_COINCIDENCES; slot++) {
+        if (coincDirty_[slot]) {
+            int start = -1, stops = 0, windowMin = 0, windowMax = 0, histMin = 0, width = 1, nbins = 1;
+            lock();
+            coincDirty_[slot] = 0;
+            getIntegerParam(slot, coincStartId_, &start);
+            getIntegerParam(slot, coincStopsId_, &stops);
+            getIntegerParam(slot, coincWindowMinId_, &windowMin);
+            getIntegerParam(slot, coincWindowMaxId_, &windowMax);
+            getIntegerParam(slot, coincHistMinId_, &histMin);
+            getIntegerParam(slot, coincHistBinWidthId_, &width);
+            getIntegerParam(slot, coincHistNbinsId_, &nbins);
+            unlock();
+
+            CoincidenceConfig config;
+            config.start = start;
+            config.stops = (uint16_t)stops;
+            config.window_min = windowMin;
+            config.window_max = windowMax;
+            config.hist_min = histMin;
+            config.hist_width = width;
+            config.hist_nbins = nbins;
+            // readInt32Array() and readFloat64Array() read the counts and axis under the lock
+            lock();
+            coinc_->configure(slot, config);
+            coinc_->axis(slot, coincAxis_ + slot * MAX_HIST_BINS, Decoder::lsb_ns(histResolution_));
+            doCallbacksFloat64Array(coincAxis_ + slot * MAX_HIST_BINS, coinc_->nbins(slot), coincAxisId_, slot);
+            unlock();
+            publish = true;
+        }
+    }
+
+    if (!publish) {
+        return;
+    }
+    lock();
+    for (int slot = 0; slot < MAX_COINCIDENCES; slot++) {
+        doCallbacksInt32Array((epicsInt32*)coinc_->counts(slot), coinc_->nbins(slot), coincHistId_, slot);
+        setIntegerParam(slot, coincCountId_, (epicsInt32)coinc_->coincidences(slot));
+        setIntegerParam(slot, coincPairsId_, (epicsInt32)coinc_->pairs(slot));
+        callParamCallbacks(slot);
+    }
+    unlock();
+}
+
+void CaenV1290N::update_histograms() {
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+
+    if (histDirty_) {
+        int min = 0, width = 1, nbins = 1;
+        lock();
+        histDirty_ = 0;
+        getIntegerParam(histMinId_, &min);
+        getIntegerParam(histBinWidthId_, &width);
+        getIntegerParam(histNbinsId_, &nbins);
+        unlock();
+
+        histPublished_.secPastEpoch = 0;
+        // readInt32Array() and readFloat64Array() read the counts and axis under the lock
+        lock();
+        hist_->configure(min, width, nbins);
+        hist_->axis(histAxis_, Decoder::lsb_ns(histResolution_));
+        doCallbacksFloat64Array(histAxis_, hist_->nbins(), histAxisId_, 0);
+        unlock();
+    }
+
+    if (totDirty_) {
+        int min = 0, width = 1, nbins = 1;
+        lock();
+        totDirty_ = 0;
+        getIntegerParam(totHistMinId_, &min);
+        getIntegerParam(totHistBinWidthId_, &width);
+        getIntegerParam(totHistNbinsId_, &nbins);
+        unlock();
+
+        histPublished_.secPastEpoch = 0;
+        lock();
+        tot_->configure(min, width, nbins);
+        tot_->axis(totAxis_, Decoder::lsb_ns(histResolution_));
+        doCallbacksFloat64Array(totAxis_, tot_->nbins(), totHistAxisId_, 0);
+        unlock();
+    }
+
+    if (epicsTimeDiffInSeconds(&now, &histPublished_) < histPeriod_) {
+        update_coincidences(false);
+        return;
+    }
+    histPublished_ = now;
+    update_coincidences(true);
+
+    lock();
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        doCallbacksInt32Array((epicsInt32*)hist_->counts(ch, Edge::Leading), hist_->nbins(), histLeadingId_, ch);
+        doCallbacksInt32Array((epicsInt32*)hist_->counts(ch, Edge::Trailing), hist_->nbins(), histTrailingId_, ch);
+        doCallbacksInt32Array((epicsInt32*)tot_->counts(ch, Edge::Leading), tot_->nbins(), totHistId_, ch);
+    }
+    unlock();
+}
+
+void CaenV1290N::update_filter() {
+    if (!filterDirty_) {
+        return;
+    }
+    int channels = 0xFFFF, edges = FilterEdge::Both, window = 0, tmin = 0, tmax = 0, min_hits = 0, max_hits = 0,
+        drop_empty = 0;
+    lock();
+    filterDirty_ = 0;
+    getIntegerParam(filterChannelsId_, &channels);
+    getIntegerParam(filterEdgesId_, &edges);
+    getIntegerParam(filterTimeWindowId_, &window);
+    getIntegerParam(filterTimeMinId_, &tmin);
+    getIntegerParam(filterTimeMaxId_, &tmax);
+    getIntegerParam(filterMinHitsId_, &min_hits);
+    getIntegerParam(filterMaxHitsId_, &max_hits);
+    getIntegerParam(filterDropEmptyId_, &drop_empty);
+    unlock();
+
+    FilterConfig config;
+    config.channels = (uint16_t)channels;
+    config.edges = edges;
+    config.time_window = window != 0;
+    config.time_min = tmin;
+    config.time_max = tmax;
+    config.min_hits = min_hits;
+    config.max_hits = max_hits;
+    config.drop_empty = drop_empty != 0;
+    filter_.configure(config);
+}
+
+void CaenV1290N::count_event_flags(const HitBatch& batch) {
+    size_t lost = 0;
+    size_t overflow = 0;
+    for (size_t e = 0; e < batch.nevents; e++) {
+        lost += (batch.flags[e] & EventFlag::TriggerLost) != 0;
+        overflow += (batch.flags[e] & EventFlag::Overflow) != 0;
+    }
+    if (lost) {
+        epicsAtomicAddSizeT(&eventsTriggerLost_, lost);
+    }
+    if (overflow) {
+        epicsAtomicAddSizeT(&eventsOverflow_, overflow);
+    }
+}
+
+void CaenV1290N::process_batch(const HitBatch& batch) {
+    if (batch.nevents == 0) {
+        return;
+    }
+    const size_t e = batch.nevents - 1;
+    const size_t nhits = batch.first_hit[e] + batch.hits[e];
+
+    // Count locally so each shared counter sees one atomic add per batch, not per hit
+    size_t counts[MAX_CHANNELS] = {0};
+    for (size_t i = 0; i < nhits; i++) {
+        if (batch.channel[i] < MAX_CHANNELS) {
+            counts[batch.channel[i]]++;
+        }
+    }
+    for (int ch = 0; ch < MAX_CHANNELS; ch++) {
+        if (counts[ch]) {
+            epicsAtomicAddSizeT(&channelHits_[ch], counts[ch]);
+        }
+    }
+    epicsAtomicAddSizeT(&hitsDecoded_, nhits);
+    epicsAtomicAddSizeT(&eventsDecoded_, batch.nevents);
+
+    hist_->fill(batch);
+    if (pairEdges_) {
+        tot_->fill_widths(batch);
+    }
+    coinc_->fill(batch);
+}
+
+void CaenV1290N::export_batch() {
+    const bool record = fileBatches_ != 0;
+    SharedBatch* next = exportEnable_ || record ? pool_.acquire() : NULL;
+    if (!next) {
+        if (exportEnable_) {
+            epicsAtomicIncrSizeT(&exportDropped_);
+        }
+        if (record) {
+            epicsAtomicIncrSizeT(&fileDropped_);
+        }
+        shared_->batch.compact();
+        return;
+    }
 
-        // read dummy registers for testing
-        val16 = 0;
-        if (!readD16(Register::Dummy16, val16)) {
-            printf("Failure reading dummy16\n");
+    next->batch.take_open(shared_->batch);
+    shared_->sequence = epicsAtomicIncrSizeT(&exportSequence_);
+    epicsTimeGetCurrent(&shared_->stamp);
+    if (exportEnable_) {
+        const HitBatch& batch = shared_->batch;
+        const size_t nhits = batch.first_hit[batch.nevents - 1] + batch.hits[batch.nevents - 1];
+        for (size_t i = 0; i < nhits; i++) {
+            exportChannel_[i] = batch.channel[i];
+        }
+        lock();
+        doCallbacksGenericPointer(shared_, exportId_, 0);
+        doCallbacksInt32Array((epicsInt32*)batch.time, nhits, exportTimeId_, 0);
+        doCallbacksInt32Array(exportChannel_, nhits, exportChannelId_, 0);
+        doCallbacksInt64Array((epicsInt64*)batch.event, nhits, exportEventId_, 0);
+        doCallbacksInt32Array((epicsInt32*)batch.width, nhits, exportWidthId_, 0);
+        unlock();
+    }
+    if (record) {
+        // The writer thread releases its reference once the batch is on disk
+        shared_->reserve();
+        SharedBatch* queued = shared_;
+        if (epicsMessageQueueTrySend(fileQueue_, &queued, sizeof(queued)) != 0) {
+            shared_->release();
+            epicsAtomicIncrSizeT(&fileDropped_);
+        }
+    }
+    shared_->release();
+    shared_ = next;
+}
+
+void CaenV1290N::process() {
+    const int reader = ring_.add_reader();
+    if (reader < 0) {
+        printf("CaenV1290N::process: no free ring reader (%d in use), nothing will be decoded\n",
+               RING_MAX_READERS);
+        return;
+    }
+    while (true) {
+        // Words before the boundary were taken the old way and are decoded that way. The flag is
+        // read first, frames_changed() publishes the boundary before it.
+        const int dirty = framesDirty_;
+        epicsAtomicReadMemoryBarrier();
+        const ptrdiff_t before = (ptrdiff_t)(epicsAtomicGetSizeT(&framesBoundary_) - ring_.position(reader));
+        if (dirty && before <= 0) {
+            framesDirty_ = 0;
+            // Nothing decoded the old way may be continued once the decoder starts over
+            shared_->batch.clear();
+            decoder_.set_time_scale(timeScale_);
+            decoder_.set_frames(continuous_ ? frameTicks_ : 0);
         }
-        setIntegerParam(dummy16Id_, val16);
+        decoder_.set_pairing(pairEdges_ != 0);
+        update_filter();
+        update_histograms();
 
-        val32 = 0;
-        if (!readD32(Register::Dummy32, val32)) {
-            printf("Failure reading dummy32\n");
+        size_t n = 0;
+        const uint32_t* words = ring_.peek(reader, n);
+        if (dirty && before > 0 && n > (size_t)before) {
+            n = (size_t)before;
+        }
+        if (n == 0) {
+            epicsThreadSleep(readout_idle_sec);
+            continue;
         }
-        setIntegerParam(dummy32Id_, val32);
 
-        val16 = 0;
-        if (!readD16(Register::EventStored, val16)) {
-            printf("Failure reading EventStored\n");
+        epicsUInt64 t0 = epicsMonotonicGet();
+        const size_t used = decoder_.decode(words, n, shared_->batch);
+        ring_.consume(reader, used);
+        latency_[Stage::Decode].add(epicsMonotonicGet() - t0);
+        if (shared_->batch.nevents > 0) {
+            t0 = epicsMonotonicGet();
+            count_event_flags(shared_->batch);
+            // Everything downstream, including export, only sees the hits and events that pass
+            filter_.apply(shared_->batch);
+            if (shared_->batch.nevents > 0) {
+                process_batch(shared_->batch);
+                export_batch();
+            }
+            latency_[Stage::Process].add(epicsMonotonicGet() - t0);
         }
-        setIntegerParam(eventsStoredId_, val16);
+    }
+}
+
+void CaenV1290N::stop_recording(int& reader, bool failed) {
+    fileBatches_ = 0;
+    if (reader >= 0) {
+        ring_.remove_reader(reader);
+        reader = -1;
+    }
+    fileWriter_.close();
 
+    // Batches the processing thread queued before it saw fileBatches_ cleared
+    SharedBatch* batch = NULL;
+    while (epicsMessageQueueTryReceive(fileQueue_, &batch, sizeof(batch)) == sizeof(batch)) {
+        batch->release();
+    }
+
+    if (failed) {
+        lock();
+        fileEnable_ = 0;
+        setIntegerParam(fileEnableId_, 0);
         callParamCallbacks();
         unlock();
-        epicsThreadSleep(poll_period_sec);
     }
 }
 
-extern "C" int initCaenV1290N(const char* portName, int baseAddress) {
-    new CaenV1290N(portName, baseAddress);
+void CaenV1290N::writer() {
+    int reader = -1;
+    bool recording = false;
+    char path[FILE_PATH_MAX];
+
+    while (true) {
+        if (fileEnable_ && !recording) {
+            int segment_mb = default_segment_mb;
+            int format = FileFormat::Raw;
+            lock();
+            getStringParam(filePathId_, sizeof(path), path);
+            getIntegerParam(fileSegmentSizeId_, &segment_mb);
+            getIntegerParam(fileFormatId_, &format);
+            unlock();
+
+            RecordedSettings settings;
+            recording = recorded_settings(settings);
+            if (!recording) {
+                printf("CaenV1290N::writer: cannot read the board settings\n");
+            }
+            recording = recording && fileWriter_.open(path, (size_t)segment_mb << 20, format, settings);
+            if (recording && format == FileFormat::Raw) {
+                reader = ring_.add_reader();
+                recording = reader >= 0;
+                if (!recording) {
+                    printf("CaenV1290N::writer: no free ring reader (%d in use)\n", RING_MAX_READERS);
+                }
+            } else if (recording) {
+                fileBatches_ = 1;
+            }
+            if (!recording) {
+                printf("CaenV1290N::writer: failed to start recording to %s\n", path);
+                stop_recording(reader, true);
+            }
+        } else if (!fileEnable_ && recording) {
+            recording = false;
+            stop_recording(reader, false);
+        }
+
+        if (!recording) {
+            epicsThreadSleep(writer_idle_sec);
+            continue;
+        }
+
+        if (fileWriter_.format() == FileFormat::Columnar) {
+            SharedBatch* batch = NULL;
+            if (epicsMessageQueueReceiveWithTimeout(fileQueue_, &batch, sizeof(batch), writer_idle_sec) !=
+                sizeof(batch)) {
+                continue;
+            }
+            const epicsUInt64 t0 = epicsMonotonicGet();
+            const bool ok = fileWriter_.write_batch(batch->batch, batch->stamp);
+            batch->release();
+            if (!ok) {
+                printf("CaenV1290N::writer: write failed, recording stopped\n");
+                recording = false;
+                stop_recording(reader, true);
+                continue;
+            }
+            latency_[Stage::Write].add(epicsMonotonicGet() - t0);
+            continue;
+        }
+
+        size_t n = 0;
+        const uint32_t* words = ring_.peek(reader, n);
+        if (n == 0) {
+            epicsThreadSleep(writer_idle_sec);
+            continue;
+        }
+
+        epicsTimeStamp now;
+        epicsTimeGetCurrent(&now);
+        const epicsUInt64 t0 = epicsMonotonicGet();
+        if (!fileWriter_.write_block(words, n, now)) {
+            printf("CaenV1290N::writer: write failed, recording stopped\n");
+            recording = false;
+            stop_recording(reader, true);
+            continue;
+        }
+        latency_[Stage::Write].add(epicsMonotonicGet() - t0);
+        ring_.consume(reader, n);
+    }
+}
+
+extern "C" int initCaenV1290N(const char* portName, int baseAddress, int intLevel, int intVector) {
+    const size_t EXTENT = 0x10000;
+    VmeBus* bus = new VmeBus("CAEN_V1290N", baseAddress, EXTENT);
+    if (!bus->ok()) {
+        printf("ERROR: Cannot initialize board.\n");
+        delete bus;
+        return (asynError);
+    }
+    new CaenV1290N(portName, bus, intLevel, intVector);
+    return (asynSuccess);
+}
+
+extern "C" int initCaenV1290NSim(const char* portName, double triggerRate, double hitsPerEvent, int useInterrupt) {
+    // The model ignores the vector, any valid level routes its interrupt to the driver
+    new CaenV1290N(portName, new SimBus(triggerRate, hitsPerEvent), useInterrupt ? 1 : 0, 0);
+    return (asynSuccess);
+}
+
+extern "C" int initCaenV1290NReplay(const char* portName, const char* path, double speed, int loop) {
+    SegmentReader* replay = new SegmentReader;
+    if (!replay->open(path)) {
+        printf("ERROR: Cannot open recording %s.\n", path ? path : "");
+        delete replay;
+        return (asynError);
+    }
+    // Registers come from an idle board model, the data from the recording
+    CaenV1290N* drv = new CaenV1290N(portName, new SimBus(0.0, 0.0), 0, 0, replay);
+    drv->set_replay(speed, loop != 0);
     return (asynSuccess);
 }
 
 static const iocshArg initArg0 = {"Port name", iocshArgString};
 static const iocshArg initArg1 = {"Base Address", iocshArgInt};
-static const iocshArg* const initArgs[2] = {&initArg0, &initArg1};
-static const iocshFuncDef initFuncDef = {"initCAEN_V1290N", 2, initArgs};
-static void initCallFunc(const iocshArgBuf* args) { initCaenV1290N(args[0].sval, args[1].ival); }
+static const iocshArg initArg2 = {"Interrupt Level (0=poll)", iocshArgInt};
+static const iocshArg initArg3 = {"Interrupt Vector", iocshArgInt};
+static const iocshArg* const initArgs[4] = {&initArg0, &initArg1, &initArg2, &initArg3};
+static const iocshFuncDef initFuncDef = {"initCAEN_V1290N", 4, initArgs};
+static void initCallFunc(const iocshArgBuf* args) {
+    initCaenV1290N(args[0].sval, args[1].ival, args[2].ival, args[3].ival);
+}
 
-void drvCaenV1290NRegister(void) { iocshRegister(&initFuncDef, initCallFunc); }
+static const iocshArg simArg0 = {"Port name", iocshArgString};
+static const iocshArg simArg1 = {"Trigger rate (Hz)", iocshArgDouble};
+static const iocshArg simArg2 = {"Mean hits per event", iocshArgDouble};
+static const iocshArg simArg3 = {"Use interrupt (0=poll)", iocshArgInt};
+static const iocshArg* const simArgs[4] = {&simArg0, &simArg1, &simArg2, &simArg3};
+static const iocshFuncDef simFuncDef = {"initCAEN_V1290N_Sim", 4, simArgs};
+static void simCallFunc(const iocshArgBuf* args) {
+    initCaenV1290NSim(args[0].sval, args[1].dval, args[2].dval, args[3].ival);
+}
+
+static const iocshArg replayArg0 = {"Port name", iocshArgString};
+static const iocshArg replayArg1 = {"Recording path prefix", iocshArgString};
+static const iocshArg replayArg2 = {"Speed (0=max, 1=recorded)", iocshArgDouble};
+static const iocshArg replayArg3 = {"Loop", iocshArgInt};
+static const iocshArg* const replayArgs[4] = {&replayArg0, &replayArg1, &replayArg2, &replayArg3};
+static const iocshFuncDef replayFuncDef = {"initCAEN_V1290N_Replay", 4, replayArgs};
+static void replayCallFunc(const iocshArgBuf* args) {
+    initCaenV1290NReplay(args[0].sval, args[1].sval, args[2].dval, args[3].ival);
+}
+
+void drvCaenV1290NRegister(void) {
+    iocshRegister(&initFuncDef, initCallFunc);
+    iocshRegister(&simFuncDef, simCallFunc);
+    iocshRegister(&replayFuncDef, replayCallFunc);
+}
 
 extern "C" {
 epicsExportRegistrar(drvCaenV1290NRegister);
@@ -1,8 +1,26 @@
 #pragma once
 #include <asynPortDriver.h>
-#include <devLib.h>
-#include <epicsMMIO.h>
+#include <epicsEvent.h>
+#include <epicsMessageQueue.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
 #include <stdint.h>
+#include <string.h>
+
+#include "V1290N.hpp"
+#include "V1290NBus.hpp"
+#include "V1290NCoincidence.hpp"
+#include "V1290NConfig.hpp"
+#include "V1290NDecoder.hpp"
+#include "V1290NExport.hpp"
+#include "V1290NFileWriter.hpp"
+#include "V1290NFilter.hpp"
+#include "V1290NHistogram.hpp"
+#include "V1290NLatency.hpp"
+#include "V1290NMicro.hpp"
+#include "V1290NRates.hpp"
+#include "V1290NReplay.hpp"
+#include "V1290NRing.hpp"
 
 // #warning "vxWorks dependent for testing"
 // #include <vxWorks.h>
@@ -25,27 +43,223 @@
 #define DUMMY16_STR "DUMMY16"
 #define EVENTS_STORED_STR "EVENTS_STORED"
 #define DEV_PARAM_STR "DEV_PARAM"
+#define READOUT_ENABLE_STR "READOUT_ENABLE"
+#define READOUT_MODE_STR "READOUT_MODE"
+#define BLT_EVENT_NUMBER_STR "BLT_EVENT_NUMBER"
+#define WORDS_READ_STR "WORDS_READ"
+#define EVENTS_READ_STR "EVENTS_READ"
+#define BLOCKS_READ_STR "BLOCKS_READ"
+#define RING_USED_STR "RING_USED"
+#define RING_STALLS_STR "RING_STALLS"
+#define HITS_DECODED_STR "HITS_DECODED"
+#define EVENTS_DECODED_STR "EVENTS_DECODED"
+#define UNKNOWN_WORDS_STR "UNKNOWN_WORDS"
+#define ALMOST_FULL_LEVEL_STR "ALMOST_FULL_LEVEL"
+#define IRQ_COUNT_STR "IRQ_COUNT"
+#define EVENT_FIFO_ENABLE_STR "EVENT_FIFO_ENABLE"
+#define HIST_MIN_STR "HIST_MIN"
+#define HIST_BIN_WIDTH_STR "HIST_BIN_WIDTH"
+#define HIST_NBINS_STR "HIST_NBINS"
+#define HIST_RESET_STR "HIST_RESET"
+#define HIST_PERIOD_STR "HIST_PERIOD"
+#define HIST_LEADING_STR "HIST_LEADING"
+#define HIST_TRAILING_STR "HIST_TRAILING"
+#define HIST_AXIS_STR "HIST_AXIS"
+#define TOT_HIST_MIN_STR "TOT_HIST_MIN"
+#define TOT_HIST_BIN_WIDTH_STR "TOT_HIST_BIN_WIDTH"
+#define TOT_HIST_NBINS_STR "TOT_HIST_NBINS"
+#define TOT_HIST_STR "TOT_HIST"
+#define TOT_HIST_AXIS_STR "TOT_HIST_AXIS"
+#define CHANNEL_HITS_STR "CHANNEL_HITS"
+#define CHANNEL_RATE_STR "CHANNEL_RATE"
+#define TRIGGER_COUNT_STR "TRIGGER_COUNT"
+#define TRIGGER_RATE_STR "TRIGGER_RATE"
+#define HIT_RATE_STR "HIT_RATE"
+#define EVENT_RATE_STR "EVENT_RATE"
+#define RATE_WINDOW_STR "RATE_WINDOW"
+#define RATE_PERIOD_STR "RATE_PERIOD"
+#define FILE_PATH_STR "FILE_PATH"
+#define FILE_ENABLE_STR "FILE_ENABLE"
+#define FILE_SEGMENT_SIZE_STR "FILE_SEGMENT_SIZE"
+#define FILE_SEGMENT_STR "FILE_SEGMENT"
+#define FILE_BYTES_WRITTEN_STR "FILE_BYTES_WRITTEN"
+#define FILE_FORMAT_STR "FILE_FORMAT"
+#define FILE_BATCHES_DROPPED_STR "FILE_BATCHES_DROPPED"
+#define SHADOW_RESYNC_STR "SHADOW_RESYNC"
+#define SHADOW_VERIFY_PERIOD_STR "SHADOW_VERIFY_PERIOD"
+#define SHADOW_MISMATCHES_STR "SHADOW_MISMATCHES"
+#define MICRO_SPIN_US_STR "MICRO_SPIN_US"
+#define MICRO_ERRORS_STR "MICRO_ERRORS"
+#define CONFIG_STR "CONFIG"
+#define FRAME_DURATION_STR "FRAME_DURATION"
+#define COINC_START_STR "COINC_START"
+#define COINC_STOPS_STR "COINC_STOPS"
+#define COINC_WINDOW_MIN_STR "COINC_WINDOW_MIN"
+#define COINC_WINDOW_MAX_STR "COINC_WINDOW_MAX"
+#define COINC_HIST_MIN_STR "COINC_HIST_MIN"
+#define COINC_HIST_BIN_WIDTH_STR "COINC_HIST_BIN_WIDTH"
+#define COINC_HIST_NBINS_STR "COINC_HIST_NBINS"
+#define COINC_RESET_STR "COINC_RESET"
+#define COINC_COUNT_STR "COINC_COUNT"
+#define COINC_PAIRS_STR "COINC_PAIRS"
+#define COINC_HIST_STR "COINC_HIST"
+#define COINC_AXIS_STR "COINC_AXIS"
+#define EXPORT_STR "EXPORT"
+#define EXPORT_ENABLE_STR "EXPORT_ENABLE"
+#define EXPORT_SEQUENCE_STR "EXPORT_SEQUENCE"
+#define EXPORT_DROPPED_STR "EXPORT_DROPPED"
+#define EXPORT_TIME_STR "EXPORT_TIME"
+#define EXPORT_CHANNEL_STR "EXPORT_CHANNEL"
+#define EXPORT_EVENT_STR "EXPORT_EVENT"
+#define EXPORT_WIDTH_STR "EXPORT_WIDTH"
+#define FILTER_CHANNELS_STR "FILTER_CHANNELS"
+#define FILTER_EDGES_STR "FILTER_EDGES"
+#define FILTER_TIME_WINDOW_STR "FILTER_TIME_WINDOW"
+#define FILTER_TIME_MIN_STR "FILTER_TIME_MIN"
+#define FILTER_TIME_MAX_STR "FILTER_TIME_MAX"
+#define FILTER_MIN_HITS_STR "FILTER_MIN_HITS"
+#define FILTER_MAX_HITS_STR "FILTER_MAX_HITS"
+#define FILTER_DROP_EMPTY_STR "FILTER_DROP_EMPTY"
+#define FILTER_HITS_DROPPED_STR "FILTER_HITS_DROPPED"
+#define FILTER_EVENTS_DROPPED_STR "FILTER_EVENTS_DROPPED"
+#define REPLAY_SPEED_STR "REPLAY_SPEED"
+#define REPLAY_LOOP_STR "REPLAY_LOOP"
+#define REPLAY_RESTART_STR "REPLAY_RESTART"
+#define REPLAY_SEGMENT_STR "REPLAY_SEGMENT"
+#define REPLAY_DONE_STR "REPLAY_DONE"
+#define STATS_RESET_STR "STATS_RESET"
+#define ALMOST_FULL_COUNT_STR "ALMOST_FULL_COUNT"
+#define FULL_COUNT_STR "FULL_COUNT"
+#define TRIGGER_LOST_COUNT_STR "TRIGGER_LOST_COUNT"
+#define EVENTS_TRIGGER_LOST_STR "EVENTS_TRIGGER_LOST"
+#define EVENTS_OVERFLOW_STR "EVENTS_OVERFLOW"
+#define EVENTS_STORED_PEAK_STR "EVENTS_STORED_PEAK"
+#define BLOCK_WORDS_MEAN_STR "BLOCK_WORDS_MEAN"
+#define BLOCK_WORDS_MAX_STR "BLOCK_WORDS_MAX"
+#define BLOCK_WORDS_HIST_STR "BLOCK_WORDS_HIST"
+#define BLOCK_WORDS_AXIS_STR "BLOCK_WORDS_AXIS"
+#define STAGE_COUNT_STR "STAGE_COUNT"
+#define STAGE_MEAN_STR "STAGE_MEAN"
+#define STAGE_P50_STR "STAGE_P50"
+#define STAGE_P99_STR "STAGE_P99"
+#define STAGE_MAX_STR "STAGE_MAX"
+#define STAGE_HIST_STR "STAGE_HIST"
+#define STAGE_AXIS_STR "STAGE_AXIS"
+#define POLL_PERIOD_STR "POLL_PERIOD"
+#define POLL_FAST_PERIOD_STR "POLL_FAST_PERIOD"
+#define POLL_FAST_HOLD_STR "POLL_FAST_HOLD"
+#define POLL_FAST_STR "POLL_FAST"
+
+// Micro controller settings mirrored in the shadow cache
+namespace Shadow {
+static const int AcquisitionMode = 0;
+static const int EdgeDetectMode = 1;
+static const int HeaderTrailer = 2;
+static const int EnablePattern = 3;
+static const int Resolution = 4;
+static const int TriggerSubtraction = 5;
+static const int Count = 6;
+} // namespace Shadow
+
+// Groups of housekeeping work poll() schedules independently, in priority order. The asyn
+// address of POLL_PERIOD selects the group.
+namespace PollGroup {
+static const int Status = 0;   // Status, EventStored and EventCounter registers
+static const int Counters = 1; // Readout and processing statistics, no bus access
+static const int Dummy = 2;    // Dummy16/Dummy32 test registers
+static const int Count = 3;
+} // namespace PollGroup
 
 class CaenV1290N : public asynPortDriver {
+    // MCST broadcasts reuse the per-board micro handshake
+    friend class CaenV1290NGroup;
+
   public:
-    CaenV1290N(const char* portName, int baseAddress);
+    /// \param bus Register access to the board, a VmeBus or a SimBus. The driver takes ownership.
+    /// \param replay Recording the readout thread replays instead of reading the board, NULL for
+    /// live data. The driver takes ownership.
+    CaenV1290N(const char* portName, V1290NBus* bus, int intLevel = 0, int intVector = 0,
+               SegmentReader* replay = NULL);
     virtual void poll();
+    virtual void readout();
+    virtual void process();
+    virtual void writer();
+    virtual void micro();
     virtual asynStatus writeInt32(asynUser* pasynUser, epicsInt32 value);
     virtual asynStatus readInt32(asynUser* pasynUser, epicsInt32* value);
     virtual asynStatus readUInt32Digital(asynUser* pasynUser, epicsUInt32* value, epicsUInt32 mask);
     virtual asynStatus writeUInt32Digital(asynUser* pasynUser, epicsUInt32 value, epicsUInt32 mask);
+    virtual asynStatus writeFloat64(asynUser* pasynUser, epicsFloat64 value);
+    virtual asynStatus readInt32Array(asynUser* pasynUser, epicsInt32* value, size_t nElements, size_t* nIn);
+    virtual asynStatus writeInt32Array(asynUser* pasynUser, epicsInt32* value, size_t nElements);
+    virtual asynStatus readFloat64Array(asynUser* pasynUser, epicsFloat64* value, size_t nElements,
+                                        size_t* nIn);
+
+    /// \brief Ring the readout thread stores raw Output Buffer words in.
+    ///
+    /// Consumers call add_reader() once and then read at their own pace without the port lock.
+    WordRing& ring() { return ring_; }
+
+    /// \brief Programs the board's MCST/CBLT address and chain position.
+    /// \param cbltAddr A31..A24 of the group's MCST/CBLT address.
+    /// \param ctrl One of the McstCblt chain positions, McstCblt::Disabled to leave the chain.
+    /// \return True on success, false on error.
+    bool set_chain(uint16_t cbltAddr, uint16_t ctrl);
+
+    /// \brief Hands readout of this board to a CBLT group, or takes it back.
+    ///
+    /// While in a group the board's own readout thread stays idle; the group enables the Event
+    /// FIFO with one event per block, and empty events so the board stores one per trigger, and
+    /// pushes demultiplexed data in through push_words().
+    /// \return True on success, false on error.
+    bool join_group(bool join);
+
+    /// \brief Reads (and optionally programs, if nonzero) the board's GEO address.
+    /// \return The 5-bit GEO address, or -1 on error.
+    int geo_address(int geo = 0);
+
+    /// \brief Number of entries in the Event FIFO, 0 on error.
+    size_t events_in_fifo();
+
+    /// \brief Pops the next Event FIFO entry and returns the word count of that event.
+    /// \return Words in the event, 0 on error.
+    size_t pop_event_fifo();
+
+    /// \brief Stores words read by a CBLT group in this board's ring as if read locally.
+    /// \return True if all words fit, false if the ring was full and the words were dropped.
+    bool push_words(const uint32_t* words, size_t n, size_t events);
+
+    /// \brief Sets how a replay driver plays its recording, see REPLAY_SPEED and REPLAY_LOOP.
+    /// \param speed Multiple of the recorded pace, 0 for as fast as possible.
+    void set_replay(double speed, bool loop);
+
+    /// \brief Duration histogram of one pipeline stage.
+    /// \param stage One of the Stage constants.
+    LatencyHistogram& latency(int stage) { return latency_[stage]; }
+
+    /// \brief VME interrupt service routine, masks the board interrupt and wakes the readout thread.
+    void isr();
 
   private:
-    // this is a "trick" since adding an offset like 0x1000 to a pointer to uint8_t moves 4 bytes
-    volatile uint8_t* base;
+    V1290NBus* bus_;
 
     /// \brief Continually tests microcontroller handshake until true, or timeout.
     ///
+    /// Polls back to back for the first microSpinUs_ microseconds, since most opcodes are
+    /// accepted within that, and only then falls back to sleeping 1 ms between polls.
+    /// Callers must hold microLock_.
     /// \param mask The mask to test handshake register with.
     /// \param timeout Timeout in milliseconds.
     /// \return True on success, false on error or timeout/
     bool wait_micro_handshake(uint16_t mask, uint16_t timeout = 1000);
 
+    /// \brief Runs a batch on the micro thread and waits for it to finish.
+    /// \return True if every command in the batch completed, false otherwise.
+    bool run_micro(MicroBatch& batch);
+
+    /// \brief Executes the commands of a batch, called on the micro thread with microLock_ held.
+    void execute_micro(MicroBatch& batch);
+
     /// \brief Writes given opcode, followed by given value to the micro register.
     ///
     /// \param opcode The opcode to write.
@@ -66,37 +280,341 @@ class CaenV1290N : public asynPortDriver {
     /// \return True on success, false on error or timeout.
     bool read_micro(uint16_t opcode, uint16_t& value);
 
-    /// \brief Performs a safe D16 VME bus write of the value to the offset
+    /// \brief Updates the shadow cache after opcode and its data words were written successfully.
+    ///
+    /// Called by the micro thread, and by a group after an MCST broadcast, with microLock_ held.
+    void shadow_written(uint16_t opcode, const uint16_t* vals = NULL, size_t nvals = 0);
+
+    /// \brief Stores one setting in the shadow cache, callers must hold microLock_.
+    ///
+    /// A change of acquisition mode also switches the decoder between events and frames.
+    void shadow_store(int field, uint16_t value);
+
+    /// \brief Marks every shadow entry stale, e.g. after a failed or interrupted micro write.
+    ///
+    /// Callers must hold microLock_.
+    void shadow_invalidate();
+
+    /// \brief Returns one micro setting from the shadow cache, reading the board only if stale.
+    /// \param field One of the Shadow constants.
+    /// \return True on success, false on error.
+    bool read_shadow(int field, uint16_t& value);
+
+    /// \brief Reads every shadowed setting back from the board and refreshes the cache.
+    ///
+    /// Entries that were valid but disagree with the board are counted in shadowMismatches_.
+    /// \return True if every setting was read, false on error (those entries stay stale).
+    bool resync_shadow();
+
+    /// \brief Has the processing thread apply the framing settings to the decoder.
+    ///
+    /// Words already in the ring were taken with the old settings, so the processing thread
+    /// decodes them first and only then drops the event still in progress and starts the
+    /// decoder over.
+    void frames_changed();
+
+    /// \brief Applies a complete TDC configuration as one micro batch.
+    ///
+    /// The batch first reads the current configuration back and then writes the new one, so
+    /// no other micro command can run in between. If a write fails, the snapshot is written
+    /// back (best effort) so the board isn't left half configured.
+    /// \param config Configuration to apply, must pass tdc_config_validate().
+    /// \return True on success, false on error.
+    bool apply_config(const TdcConfig& config);
+
+    /// \brief Reads the complete TDC configuration back from the board in one micro batch.
+    /// \return True on success, false on error.
+    bool snapshot_config(TdcConfig& config);
+
+    /// \brief Programs the Control register bits the given readout mode depends on.
+    ///
+    /// BLT and MBLT reads go through the CPU-mapped Output Buffer window, so BERR_EN must be
+    /// off (the board returns filler words when empty instead of raising a bus error) and
+    /// MBLT additionally needs ALIGN64 so every event is padded to a 64-bit boundary.
+    /// Callers must hold readoutLock_.
+    /// \param mode One of the ReadoutMode constants.
+    /// \return True on success, false on error.
+    bool configure_readout(int mode);
+
+    /// \brief Writes the Control register and resyncs the readout state cached from it.
+    ///
+    /// Waits for the block transfer in progress, since the write clears the module.
+    /// \param keep Bits to keep at their current value on the board instead of taking them
+    /// from value, e.g. the ones the readout mode or a CBLT group depend on.
+    /// \return True on success, false on error.
+    bool write_control(uint16_t value, uint16_t keep = 0);
+
+    /// \brief Connects the ISR and programs IntVector/IntLevel so the board interrupts when
+    /// the Output Buffer reaches AlmostFullLevel.
+    /// \return True on success, false on error.
+    bool connect_interrupt();
+
+    /// \brief Re-enables the board interrupt after the readout thread has drained the buffer.
+    void arm_interrupt();
+
+    /// \brief Blocks the readout thread until the ISR fires, or briefly when not using interrupts.
+    void wait_for_data();
+
+    /// \brief Counts Status flag transitions and times AlmostFull, from the readout thread.
+    void note_status(uint16_t status);
+
+    /// \brief Moves the next part of the replayed recording into the ring.
+    ///
+    /// Runs in the readout thread in place of reading the board. At a nonzero REPLAY_SPEED each
+    /// block waits until its recorded time, scaled by the speed, has come; at 0 the replay runs
+    /// as fast as the ring drains.
+    void replay_block();
+
+    /// \brief Puts the board model of a replay into the settings a segment was recorded with.
+    ///
+    /// Goes through the micro controller like any other configuration, so the shadow cache and
+    /// the decoder follow. Called from the readout thread whenever the settings change.
+    void apply_recorded_settings(const RecordedSettings& settings);
+
+    /// \brief Collects the settings stored in the headers of a new recording.
+    /// \return True on success, false if the board couldn't be read.
+    bool recorded_settings(RecordedSettings& settings);
+
+    /// \brief Drains up to one block of data words from the Output Buffer.
+    ///
+    /// The block ends at the first filler word, after BltEventNumber global trailers (if
+    /// nonzero), or when max_words have been read, whichever comes first.
+    /// \param dst Buffer to store the data words in.
+    /// \param max_words Capacity of dst in words.
+    /// \param events Incremented by the number of global trailers read.
+    /// \return Number of words stored in dst, not counting the terminating filler.
+    size_t read_block(uint32_t* dst, size_t max_words, size_t& events);
+
+    /// \brief Drains whole events from the Output Buffer using the sizes in the Event FIFO.
+    ///
+    /// Pops up to BltEventNumber (or all stored) Event FIFO entries and then transfers exactly
+    /// the words they describe, so no termination word or bus error is needed. Words that don't
+    /// fit in max_words stay pending and are transferred by the next call.
+    /// \param dst Buffer to store the data words in.
+    /// \param max_words Capacity of dst in words.
+    /// \param events Incremented by the number of events completely transferred.
+    /// \return Number of words stored in dst.
+    size_t read_fifo_block(uint32_t* dst, size_t max_words, size_t& events);
+
+    /// \brief Transfers exactly n words from the Output Buffer in the current readout mode.
+    /// \return Number of words stored in dst, less than n only if the first probe fails.
+    size_t transfer_words(uint32_t* dst, size_t n);
+
+    /// \brief Performs an unchecked D32 read of Output Buffer word i (modulo the window size).
+    uint32_t outbuf_word(size_t i) { return bus_->outbuf_word(i); }
+
+    /// \brief Performs an unchecked 64-bit read of Output Buffer words i and i+1.
+    /// \param i Word index, must be even.
+    /// \param dst Destination for the two words, in bus order.
+    void outbuf_dword(size_t i, uint32_t* dst) { bus_->outbuf_dword(i, dst); }
+
+    /// \brief Applies pending histogram settings and publishes the histograms when due.
+    ///
+    /// Called from the processing thread only, takes the port lock while publishing.
+    void update_histograms();
+
+    /// \brief Ends a recording started by writer(), releasing any batches still queued.
+    /// \param failed True to also clear FILE_ENABLE, e.g. after a write error.
+    void stop_recording(int& reader, bool failed);
+
+    /// \brief Reconfigures the hit filter from its params when they changed.
+    ///
+    /// Called from the processing thread.
+    void update_filter();
+
+    /// \brief Applies pending coincidence settings and publishes the results.
+    ///
+    /// Called from update_histograms(), so results go out at the histogram period.
+    /// \param publish True to publish the histograms and counts now.
+    void update_coincidences(bool publish);
+
+    /// \brief Services one poll group, reading its registers without the port lock.
+    /// \param t Seconds since the driver started.
+    void poll_group(int group, double t);
+
+    /// \brief Samples the hit, event and trigger counters and publishes their rates.
+    ///
+    /// Called from poll() with the port lock held.
+    /// \param t Seconds since the driver started.
+    void update_rates(double t);
+
+    /// \brief Hands the complete events of the current batch to EXPORT subscribers.
+    ///
+    /// Called from the processing thread only. When exporting, the batch goes out as is and
+    /// decoding continues in a fresh pooled batch that takes over the open event; otherwise
+    /// (or if every pooled batch is still held by subscribers) the batch is compacted in place.
+    /// EXPORT passes a pointer and only reaches subscribers in the IOC's own process; the
+    /// EXPORT_TIME, EXPORT_CHANNEL, EXPORT_EVENT and EXPORT_WIDTH arrays carry the same hits
+    /// to waveform records and Channel Access clients.
+    void export_batch();
+
+    /// \brief Counts events whose trailer reports a lost trigger or Output Buffer overflow.
+    ///
+    /// Called from the processing thread before the filter, so dropped events are counted too.
+    void count_event_flags(const HitBatch& batch);
+
+    /// \brief Runs every downstream stage on the complete events of a decoded batch.
+    ///
+    /// Called from the processing thread only.
+    void process_batch(const HitBatch& batch);
+
+    // Readout state, written by the readout thread and published by poll(). The readout thread
+    // holds readoutLock_ for each transfer; settings the transfer depends on (readout mode,
+    // Event FIFO) are only changed with it held, so they never change mid-block.
+    WordRing ring_;
+    epicsMutexId readoutLock_;
+    int readoutEnable_;
+    int readoutMode_;
+    uint16_t bltEventNumber_;
+    size_t wordsRead_;
+    size_t eventsRead_;
+    size_t blocksRead_;
+    size_t ringStalls_;
+    volatile int groupMember_;
+    int eventFifo_;
+    size_t fifoPendingWords_;
+    size_t fifoPendingEvents_;
+
+    // Interrupt state. With intLevel_ == 0 the readout thread polls the Status register instead.
+    int intLevel_;
+    int intVector_;
+    epicsEventId readoutEvent_;
+    volatile int irqArmed_;
+    size_t irqCount_;
+
+    // Processing state, owned by the processing thread
+    Decoder decoder_;
+    HitFilter filter_;
+    volatile int filterDirty_; // Filter params changed, applied by the processing thread
+    BatchPool pool_;
+    SharedBatch* shared_; // Batch being decoded into, always borrowed from pool_
+    volatile int exportEnable_;
+    size_t exportSequence_;
+    size_t exportDropped_;
+    epicsInt32* exportChannel_; // Channel column widened for EXPORT_CHANNEL
+    size_t hitsDecoded_;
+    size_t eventsDecoded_;
+    TimeHistograms* hist_;
+    epicsFloat64* histAxis_;
+    volatile int histResolution_; // Shadowed edge resolution code the ns axes use, 25 ps until known
+    volatile int histDirty_;
+    double histPeriod_;
+    epicsTimeStamp histPublished_;
+
+    // Time over threshold, paired by the decoder in edge detection mode 3 (leading and trailing)
+    volatile int pairEdges_;
+    TimeHistograms* tot_;
+    epicsFloat64* totAxis_;
+    volatile int totDirty_;
+
+    // Coincidences, owned by the processing thread
+    CoincidenceEngine* coinc_;
+    epicsFloat64* coincAxis_;
+    volatile int coincDirty_[MAX_COINCIDENCES];
+
+    // Continuous mode framing, applied to the decoder by the processing thread when dirty, from
+    // ring position framesBoundary_ on
+    volatile int continuous_;
+    volatile uint32_t frameTicks_;
+    volatile int framesDirty_;
+    size_t framesBoundary_;
+    volatile uint32_t timeScale_; // Decoder::time_scale() of the shadowed settings
+
+    // Hit counters, written by the processing thread with epicsAtomic and sampled by poll()
+    size_t channelHits_[MAX_CHANNELS];
+    RateMeter rates_;
+    double ratePeriod_;
+
+    // Poll scheduler. The Status group drops to pollFastPeriod_ until pollFastUntil_ (seconds
+    // since start) after the board reports AlmostFull, Full or TriggerLost.
+    double pollPeriod_[PollGroup::Count];
+    double pollFastPeriod_;
+    double pollFastHold_;
+    double pollFastUntil_;
+    uint32_t lastEventCounter_;
+    size_t triggerCount_;
+
+    // Offline replay, owned by the readout thread. replayLeft_ words of the current block at
+    // replayNext_ are still to go into the ring.
+    SegmentReader* replay_;
+    const uint32_t* replayNext_;
+    size_t replayLeft_;
+    volatile double replaySpeed_;
+    volatile int replayLoop_;
+    volatile int replayRestart_;
+    int replayDone_;
+    bool replayPaced_;           // replayBase*_ hold the first paced block
+    bool replaySettingsKnown_;   // replaySettings_ were applied to the board model
+    RecordedSettings replaySettings_;
+    epicsTimeStamp replayBaseTime_;
+    epicsUInt64 replayBaseMono_;
+
+    // File writer, owned by the writer thread. While recording it holds a ring reader for the raw
+    // format, or sets fileBatches_ to have the processing thread queue decoded batches on
+    // fileQueue_ for the columnar format.
+    FileWriter fileWriter_;
+    volatile int fileEnable_;
+    volatile int fileBatches_;
+    epicsMessageQueueId fileQueue_;
+    size_t fileDropped_;
+
+    // Per-stage durations, each written only by the thread running that stage
+    LatencyHistogram latency_[Stage::Count];
+
+    // Readout diagnostics. Status transitions are seen by the readout thread, which also times
+    // AlmostFull (Stage::Drain) and records how many words each block brought in. Trailer flags
+    // are counted by the processing thread with epicsAtomic, the EventStored peak by poll().
+    LatencyHistogram blockWords_;
+    uint16_t lastStatus_;
+    epicsUInt64 almostFullSince_; // epicsMonotonicGet() when AlmostFull was first seen, 0 if clear
+    size_t almostFullCount_;
+    size_t fullCount_;
+    size_t triggerLostCount_;
+    size_t eventsTriggerLost_;
+    size_t eventsOverflow_;
+    uint16_t eventsStoredPeak_;
+    size_t storedFailures_; // Consecutive failed EventStored reads, reported when they start and end
+
+    // Micro controller access. Batches are queued to the micro thread, which holds microLock_
+    // while it talks to the board; a group holds it too while broadcasting.
+    epicsMessageQueueId microQueue_;
+    epicsMutexId microLock_;
+    volatile int microSpinUs_;
+    size_t microErrors_;
+
+    // Shadow copy of the micro controller settings, protected by microLock_
+    uint16_t shadow_[Shadow::Count];
+    int shadowValid_[Shadow::Count];
+    double shadowVerifyPeriod_;
+    size_t shadowMismatches_;
+    volatile int shadowResyncDue_; // A configuration load invalidated the cache, poll() rereads it
+
+    // Last configuration applied through CONFIG, supplies the settings the board can't read back
+    TdcConfig config_;
+
+    /// \brief Performs a safe D16 bus write of the value to the offset
     /// \param offset The offset from the base address to write to
     /// \param value The value to write
     /// \return True on success, false on error
-    bool writeD16(uint16_t offset, uint16_t value) {
-        return !devWriteProbe(sizeof(uint16_t), base + offset, &value);
-    }
+    bool writeD16(uint16_t offset, uint16_t value) { return bus_->write16(offset, value); }
 
-    /// \brief Performs a safe D16 VME bus read of the offset location
+    /// \brief Performs a safe D16 bus read of the offset location
     /// \param offset The offset from the base address to write to
     /// \param value The value to store the read data
     /// \return True on success, false on error
-    bool readD16(uint16_t offset, uint16_t& value) {
-        return !devReadProbe(sizeof(uint16_t), base + offset, &value);
-    }
+    bool readD16(uint16_t offset, uint16_t& value) { return bus_->read16(offset, value); }
 
-    /// \brief Performs a safe D32 VME bus write of the value to the offset
+    /// \brief Performs a safe D32 bus write of the value to the offset
     /// \param offset The offset from the base address to write to
     /// \param value The value to write
     /// \return True on success, false on error
-    bool writeD32(uint32_t offset, uint32_t value) {
-        return !devWriteProbe(sizeof(uint32_t), base + offset, &value);
-    }
+    bool writeD32(uint32_t offset, uint32_t value) { return bus_->write32(offset, value); }
 
-    /// \brief Performs a safe D32 VME bus read of the offset location
+    /// \brief Performs a safe D32 bus read of the offset location
     /// \param offset The offset from the base address to write to
     /// \param value The value to store the read data
     /// \return True on success, false on error
-    bool readD32(uint32_t offset, uint32_t& value) {
-        return !devReadProbe(sizeof(uint32_t), base + offset, &value);
-    }
+    bool readD32(uint32_t offset, uint32_t& value) { return bus_->read32(offset, value); }
 
     // // devWriteProbe is the OSI abstraction on top of vxMemProbe, so as expected,
     // // this appears to give the same result as CaenV1290N::writeD16
@@ -145,4 +663,110 @@ class CaenV1290N : public asynPortDriver {
     int dummy16Id_;
     int dummy32Id_;
     int devParamId_;
+    int readoutEnableId_;
+    int readoutModeId_;
+    int bltEventNumberId_;
+    int wordsReadId_;
+    int eventsReadId_;
+    int blocksReadId_;
+    int ringUsedId_;
+    int ringStallsId_;
+    int hitsDecodedId_;
+    int eventsDecodedId_;
+    int unknownWordsId_;
+    int almostFullLevelId_;
+    int irqCountId_;
+    int eventFifoEnableId_;
+    int histMinId_;
+    int histBinWidthId_;
+    int histNbinsId_;
+    int histResetId_;
+    int histPeriodId_;
+    int histLeadingId_;
+    int histTrailingId_;
+    int histAxisId_;
+    int totHistMinId_;
+    int totHistBinWidthId_;
+    int totHistNbinsId_;
+    int totHistId_;
+    int totHistAxisId_;
+    int channelHitsId_;
+    int channelRateId_;
+    int triggerCountId_;
+    int triggerRateId_;
+    int hitRateId_;
+    int eventRateId_;
+    int rateWindowId_;
+    int ratePeriodId_;
+    int filePathId_;
+    int fileEnableId_;
+    int fileSegmentSizeId_;
+    int fileSegmentId_;
+    int fileBytesWrittenId_;
+    int fileFormatId_;
+    int fileBatchesDroppedId_;
+    int shadowResyncId_;
+    int shadowVerifyPeriodId_;
+    int shadowMismatchesId_;
+    int microSpinUsId_;
+    int microErrorsId_;
+    int configId_;
+    int frameDurationId_;
+    int coincStartId_;
+    int coincStopsId_;
+    int coincWindowMinId_;
+    int coincWindowMaxId_;
+    int coincHistMinId_;
+    int coincHistBinWidthId_;
+    int coincHistNbinsId_;
+    int coincResetId_;
+    int coincCountId_;
+    int coincPairsId_;
+    int coincHistId_;
+    int coincAxisId_;
+    int exportId_;
+    int exportEnableId_;
+    int exportSequenceId_;
+    int exportDroppedId_;
+    int exportTimeId_;
+    int exportChannelId_;
+    int exportEventId_;
+    int exportWidthId_;
+    int filterChannelsId_;
+    int filterEdgesId_;
+    int filterTimeWindowId_;
+    int filterTimeMinId_;
+    int filterTimeMaxId_;
+    int filterMinHitsId_;
+    int filterMaxHitsId_;
+    int filterDropEmptyId_;
+    int filterHitsDroppedId_;
+    int filterEventsDroppedId_;
+    int replaySpeedId_;
+    int replayLoopId_;
+    int replayRestartId_;
+    int replaySegmentId_;
+    int replayDoneId_;
+    int statsResetId_;
+    int almostFullCountId_;
+    int fullCountId_;
+    int triggerLostCountId_;
+    int eventsTriggerLostId_;
+    int eventsOverflowId_;
+    int eventsStoredPeakId_;
+    int blockWordsMeanId_;
+    int blockWordsMaxId_;
+    int blockWordsHistId_;
+    int blockWordsAxisId_;
+    int stageCountId_;
+    int stageMeanId_;
+    int stageP50Id_;
+    int stageP99Id_;
+    int stageMaxId_;
+    int stageHistId_;
+    int stageAxisId_;
+    int pollPeriodId_;
+    int pollFastPeriodId_;
+    int pollFastHoldId_;
+    int pollFastId_;
 };
@@ -0,0 +1,417 @@
+#include <devLib.h>
+#include <epicsExport.h>
+#include <iocsh.h>
+#include <string.h>
+
+#include "V1290N.hpp"
+#include "drvCaenV1290N.hpp"
+#include "drvCaenV1290NGroup.hpp"
+
+static void poll_thread_C(void* pPvt) {
+    CaenV1290NGroup* pGroup = (CaenV1290NGroup*)pPvt;
+    pGroup->poll();
+}
+
+static void readout_thread_C(void* pPvt) {
+    CaenV1290NGroup* pGroup = (CaenV1290NGroup*)pPvt;
+    pGroup->readout();
+}
+
+const double group_poll_period_sec = 0.5;
+
+// How long the group readout thread sleeps while waiting for every board to see the trigger
+const double group_idle_sec = 0.001;
+
+// How long some boards may hold an event while others have none before the group reads the
+// ones that do, e.g. after a board missed a trigger or was cleared on its own
+const double group_sync_timeout_sec = 0.5;
+
+const int ASYN_INTERFACE_MASK = asynInt32Mask | asynUInt32DigitalMask | asynDrvUserMask;
+const int ASYN_INTERRUPT_MASK = asynInt32Mask | asynUInt32DigitalMask;
+
+// The MCST window covers the whole register map, the CBLT window is its first 4 kB
+const size_t GROUP_EXTENT = 0x10000;
+
+CaenV1290NGroup::CaenV1290NGroup(const char* portName, int cbltAddr)
+    : asynPortDriver(portName, 1,
+            ASYN_INTERFACE_MASK, ASYN_INTERRUPT_MASK,
+            0, 1, 0, 0),
+      base(NULL), cbltAddr_(cbltAddr & McstCblt::AddrMask), buf_((size_t)OUTBUF_MAX_WORDS),
+      enabled_(0), cycles_(0), words_(0), errors_(0), resyncs_(0) {
+
+    memset(byGeo_, 0, sizeof(byGeo_));
+
+    // All boards in the chain answer CBLT reads and MCST writes at A31..A24 = cbltAddr
+    volatile void* ptr;
+    if (devRegisterAddress("CAEN_V1290N_CBLT", atVMEA32, (size_t)cbltAddr_ << 24, GROUP_EXTENT, &ptr)) {
+        printf("ERROR: devRegisterAddress failed for CBLT address 0x%02X. Cannot initialize group.\n",
+               cbltAddr_);
+        return;
+    }
+    base = (volatile uint8_t*)ptr;
+
+    createParam(CBLT_ENABLE_STR, asynParamInt32, &cbltEnableId_);
+    createParam(NUM_BOARDS_STR, asynParamInt32, &numBoardsId_);
+    createParam(CBLT_CYCLES_STR, asynParamInt32, &cbltCyclesId_);
+    createParam(CBLT_WORDS_STR, asynParamInt32, &cbltWordsId_);
+    createParam(CBLT_ERRORS_STR, asynParamInt32, &cbltErrorsId_);
+    createParam(CBLT_RESYNCS_STR, asynParamInt32, &cbltResyncsId_);
+    createParam(ACQUISITION_MODE_STR, asynParamInt32, &acquisitionModeId_);
+    createParam(EDGE_DETECT_MODE_STR, asynParamInt32, &edgeDetectModeId_);
+    createParam(ENABLE_PATTERN_STR, asynParamUInt32Digital, &enablePatternId_);
+    createParam(WINDOW_WIDTH_STR, asynParamInt32, &windowWidthId_);
+    createParam(WINDOW_OFFSET_STR, asynParamInt32, &windowOffsetId_);
+    createParam(TDC_HEADER_TRAILER_STR, asynParamInt32, &tdcHeaderTrailerId_);
+    createParam(CONTROL_STR, asynParamUInt32Digital, &controlId_);
+    createParam(SOFTWARE_CLEAR_STR, asynParamInt32, &softwareClearId_);
+    createParam(SOFTWARE_EVENT_RESET_STR, asynParamInt32, &softwareEventResetId_);
+
+    setIntegerParam(cbltEnableId_, 0);
+    setIntegerParam(numBoardsId_, 0);
+
+    epicsThreadCreate("CaenV1290NGroupPoller", epicsThreadPriorityLow,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), (EPICSTHREADFUNC)poll_thread_C, this);
+    epicsThreadCreate("CaenV1290NGroupReadout", epicsThreadPriorityHigh,
+                      epicsThreadGetStackSize(epicsThreadStackMedium), (EPICSTHREADFUNC)readout_thread_C, this);
+}
+
+bool CaenV1290NGroup::add_board(CaenV1290N* board, int geo) {
+    if (enabled_) {
+        printf("add_board: disable CBLT before changing the chain\n");
+        return false;
+    }
+    if (boards_.size() >= MAX_GROUP_BOARDS) {
+        printf("add_board: group already has %d boards\n", MAX_GROUP_BOARDS);
+        return false;
+    }
+
+    const int g = board->geo_address(geo);
+    if (g < 0) {
+        printf("add_board: failed to access GEO address register\n");
+        return false;
+    }
+    if (byGeo_[g]) {
+        printf("add_board: GEO address %d already used in this group\n", g);
+        return false;
+    }
+
+    byGeo_[g] = board;
+    boards_.push_back(board);
+    buf_.resize(boards_.size() * (size_t)OUTBUF_MAX_WORDS);
+
+    // The previous last board becomes an intermediate one
+    if (!program_chain()) {
+        printf("add_board: failed to program MCST/CBLT chain\n");
+        return false;
+    }
+
+    lock();
+    setIntegerParam(numBoardsId_, (int)boards_.size());
+    callParamCallbacks();
+    unlock();
+    return true;
+}
+
+bool CaenV1290NGroup::program_chain() {
+    bool ok = true;
+    const size_t n = boards_.size();
+    for (size_t i = 0; i < n; i++) {
+        uint16_t ctrl = McstCblt::Active;
+        if (i == n - 1) {
+            ctrl = McstCblt::Last;
+        } else if (i == 0) {
+            ctrl = McstCblt::First;
+        }
+        if (!boards_[i]->set_chain(cbltAddr_, ctrl)) {
+            printf("program_chain: failed to program board %d\n", (int)i);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool CaenV1290NGroup::configure_cblt(bool enable) {
+    bool ok = true;
+    for (size_t i = 0; i < boards_.size(); i++) {
+        if (!boards_[i]->join_group(enable)) {
+            printf("configure_cblt: failed to configure board %d\n", (int)i);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool CaenV1290NGroup::wait_all_micro() {
+    for (size_t i = 0; i < boards_.size(); i++) {
+        if (!boards_[i]->wait_micro_handshake(Handshake::WriteOk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CaenV1290NGroup::mcst_write_micro(uint16_t opcode, const uint16_t* vals, size_t nvals) {
+    if (boards_.empty()) {
+        return false;
+    }
+
+    // Keep every board's micro thread off its micro register for the whole broadcast
+    for (size_t b = 0; b < boards_.size(); b++) {
+        epicsMutexLock(boards_[b]->microLock_);
+    }
+
+    bool ok = true;
+    if (!wait_all_micro() || !mcst_writeD16(Register::Micro, opcode)) {
+        printf("mcst_write_micro: failed to broadcast opcode 0x%04X\n", opcode);
+        ok = false;
+    }
+    for (size_t i = 0; ok && i < nvals; i++) {
+        if (!wait_all_micro() || !mcst_writeD16(Register::Micro, vals[i])) {
+            printf("mcst_write_micro: failed to broadcast data for opcode 0x%04X\n", opcode);
+            ok = false;
+        }
+    }
+
+    // Keep each board's shadow cache in step with the broadcast
+    for (size_t b = boards_.size(); b-- > 0;) {
+        if (ok) {
+            boards_[b]->shadow_written(opcode, vals, nvals);
+        } else {
+            boards_[b]->shadow_invalidate();
+        }
+        epicsMutexUnlock(boards_[b]->microLock_);
+    }
+    return ok;
+}
+
+size_t CaenV1290NGroup::transfer_words(uint32_t* dst, size_t n) {
+    if (n == 0 || devReadProbe(sizeof(uint32_t), base, dst)) {
+        return 0;
+    }
+    for (size_t i = 1; i < n; i++) {
+        dst[i] = nat_ioread32(base + ((i * sizeof(uint32_t)) & (OUTBUF_WINDOW_BYTES - 1)));
+    }
+    return n;
+}
+
+void CaenV1290NGroup::demux(const uint32_t* words, size_t n) {
+    size_t start = 0;
+    CaenV1290N* board = NULL;
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t type = words[i] >> DataWord::TypeShift;
+        if (type == DataWord::GlobalHeader) {
+            start = i;
+            board = byGeo_[words[i] & DataWord::GeoMask];
+            if (!board) {
+                errors_++;
+            }
+        } else if (type == DataWord::GlobalTrailer && board) {
+            if (!board->push_words(words + start, i + 1 - start, 1)) {
+                errors_++;
+            }
+            board = NULL;
+        }
+    }
+}
+
+void CaenV1290NGroup::readout() {
+    bool holding[MAX_GROUP_BOARDS];
+    epicsUInt64 waitingSince = 0; // epicsMonotonicGet() when only part of the chain had an event
+
+    while (true) {
+        if (!enabled_ || boards_.empty()) {
+            waitingSince = 0;
+            epicsThreadSleep(group_idle_sec);
+            continue;
+        }
+
+        // A CBLT moves one event from every board holding one, so only start once the trigger
+        // has reached the whole chain; otherwise a board could join mid-transfer.
+        size_t nholding = 0;
+        for (size_t i = 0; i < boards_.size(); i++) {
+            holding[i] = boards_[i]->events_in_fifo() > 0;
+            nholding += holding[i];
+        }
+        if (nholding == 0) {
+            waitingSince = 0;
+            epicsThreadSleep(group_idle_sec);
+            continue;
+        }
+        if (nholding < boards_.size()) {
+            // Every member stores an event per trigger, so a board still empty after the timeout
+            // missed one. Read the others rather than stall the whole group on it.
+            const epicsUInt64 now = epicsMonotonicGet();
+            if (waitingSince == 0) {
+                waitingSince = now;
+            }
+            if (now - waitingSince < (epicsUInt64)(group_sync_timeout_sec * 1e9)) {
+                epicsThreadSleep(group_idle_sec);
+                continue;
+            }
+            resyncs_++;
+        }
+        waitingSince = 0;
+
+        size_t total = 0;
+        for (size_t i = 0; i < boards_.size(); i++) {
+            if (holding[i]) {
+                total += boards_[i]->pop_event_fifo();
+            }
+        }
+        if (total > buf_.size()) {
+            errors_++;
+            total = buf_.size();
+        }
+
+        const size_t n = transfer_words(&buf_[0], total);
+        if (n > 0) {
+            demux(&buf_[0], n);
+            cycles_++;
+            words_ += n;
+        }
+    }
+}
+
+asynStatus CaenV1290NGroup::writeInt32(asynUser* pasynUser, epicsInt32 value) {
+    const int function = pasynUser->reason;
+    asynStatus asyn_status = asynSuccess;
+
+    uint16_t v16 = value;
+    if (function == cbltEnableId_) {
+        if (value) {
+            if (!configure_cblt(true)) {
+                configure_cblt(false);
+                asyn_status = asynError;
+            } else {
+                enabled_ = 1;
+            }
+        } else {
+            enabled_ = 0;
+            if (!configure_cblt(false)) {
+                asyn_status = asynError;
+            }
+        }
+        setIntegerParam(cbltEnableId_, enabled_);
+    } else if (function == edgeDetectModeId_) {
+        if (!mcst_write_micro(Opcode::SetEdgeDetectionMode, &v16, 1)) {
+            asyn_status = asynError;
+        }
+    } else if (function == acquisitionModeId_) {
+        if (!mcst_write_micro(value == 0 ? Opcode::SetContinuous : Opcode::SetTriggerMatch)) {
+            asyn_status = asynError;
+        }
+    } else if (function == windowWidthId_) {
+        if (!mcst_write_micro(Opcode::SetWindowWidth, &v16, 1)) {
+            asyn_status = asynError;
+        }
+    } else if (function == windowOffsetId_) {
+        if (!mcst_write_micro(Opcode::SetWindowOffset, &v16, 1)) {
+            asyn_status = asynError;
+        }
+    } else if (function == tdcHeaderTrailerId_) {
+        if (!mcst_write_micro(value == 0 ? Opcode::DisableTDCHeaderTrailer : Opcode::EnableTDCHeaderTrailer)) {
+            asyn_status = asynError;
+        }
+    } else if (function == softwareClearId_) {
+        if (!mcst_writeD16(Register::SwClear, v16)) {
+            asyn_status = asynError;
+        }
+    } else if (function == softwareEventResetId_) {
+        if (!mcst_writeD16(Register::SwEventReset, v16)) {
+            asyn_status = asynError;
+        }
+    }
+
+    if (asyn_status == asynSuccess) {
+        setIntegerParam(function, value);
+    }
+
+    if (asyn_status) {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "Error in CaenV1290NGroup::writeInt32\n");
+    }
+
+    callParamCallbacks();
+    return asyn_status;
+}
+
+asynStatus CaenV1290NGroup::writeUInt32Digital(asynUser* pasynUser, epicsUInt32 value, epicsUInt32 mask) {
+    const int function = pasynUser->reason;
+    asynStatus asyn_status = asynSuccess;
+
+    uint16_t v16 = value & mask;
+    if (function == enablePatternId_) {
+        if (!mcst_write_micro(Opcode::WriteEnablePattern, &v16, 1)) {
+            asyn_status = asynError;
+        }
+    } else if (function == controlId_) {
+        // Written board by board rather than broadcast: the bits the readout mode and the CBLT
+        // setup depend on differ per board, so each keeps its own and resyncs its cached state
+        const uint16_t keep = Control::BerrEn | Control::Align64 | Control::EventFifoEn |
+                              (enabled_ ? Control::EmptyEvent : 0);
+        for (size_t b = 0; b < boards_.size(); b++) {
+            if (!boards_[b]->write_control(v16, keep)) {
+                printf("writeUInt32Digital: failed to write Control of board %d\n", (int)b);
+                asyn_status = asynError;
+            }
+        }
+    }
+
+    if (asyn_status) {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "Error in CaenV1290NGroup::writeUInt32Digital\n");
+    } else {
+        setUIntDigitalParam(function, value, mask);
+        callParamCallbacks();
+    }
+
+    return asyn_status;
+}
+
+void CaenV1290NGroup::poll() {
+    while (true) {
+        lock();
+        setIntegerParam(cbltCyclesId_, (epicsInt32)cycles_);
+        setIntegerParam(cbltWordsId_, (epicsInt32)words_);
+        setIntegerParam(cbltErrorsId_, (epicsInt32)errors_);
+        setIntegerParam(cbltResyncsId_, (epicsInt32)resyncs_);
+        callParamCallbacks();
+        unlock();
+        epicsThreadSleep(group_poll_period_sec);
+    }
+}
+
+extern "C" int initCaenV1290NGroup(const char* portName, int cbltAddr) {
+    new CaenV1290NGroup(portName, cbltAddr);
+    return (asynSuccess);
+}
+
+extern "C" int addCaenV1290NGroup(const char* groupPort, const char* boardPort, int geo) {
+    CaenV1290NGroup* group = dynamic_cast<CaenV1290NGroup*>((asynPortDriver*)findAsynPortDriver(groupPort));
+    CaenV1290N* board = dynamic_cast<CaenV1290N*>((asynPortDriver*)findAsynPortDriver(boardPort));
+    if (!group || !board) {
+        printf("addCAEN_V1290N_Group: no V1290N group \"%s\" or board \"%s\"\n", groupPort, boardPort);
+        return (asynError);
+    }
+    return group->add_board(board, geo) ? (asynSuccess) : (asynError);
+}
+
+static const iocshArg initArg0 = {"Port name", iocshArgString};
+static const iocshArg initArg1 = {"CBLT Address (A31..A24)", iocshArgInt};
+static const iocshArg* const initArgs[2] = {&initArg0, &initArg1};
+static const iocshFuncDef initFuncDef = {"initCAEN_V1290N_Group", 2, initArgs};
+static void initCallFunc(const iocshArgBuf* args) { initCaenV1290NGroup(args[0].sval, args[1].ival); }
+
+static const iocshArg addArg0 = {"Group port name", iocshArgString};
+static const iocshArg addArg1 = {"Board port name", iocshArgString};
+static const iocshArg addArg2 = {"GEO Address (0=keep)", iocshArgInt};
+static const iocshArg* const addArgs[3] = {&addArg0, &addArg1, &addArg2};
+static const iocshFuncDef addFuncDef = {"addCAEN_V1290N_Group", 3, addArgs};
+static void addCallFunc(const iocshArgBuf* args) { addCaenV1290NGroup(args[0].sval, args[1].sval, args[2].ival); }
+
+void drvCaenV1290NGroupRegister(void) {
+    iocshRegister(&initFuncDef, initCallFunc);
+    iocshRegister(&addFuncDef, addCallFunc);
+}
+
+extern "C" {
+epicsExportRegistrar(drvCaenV1290NGroupRegister);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <asynPortDriver.h>
+#include <devLib.h>
+#include <epicsMMIO.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "V1290N.hpp"
+
+class CaenV1290N;
+
+#define MAX_GROUP_BOARDS 20
+
+// String names for asyn parameters
+#define CBLT_ENABLE_STR "CBLT_ENABLE"
+#define NUM_BOARDS_STR "NUM_BOARDS"
+#define CBLT_CYCLES_STR "CBLT_CYCLES"
+#define CBLT_WORDS_STR "CBLT_WORDS"
+#define CBLT_ERRORS_STR "CBLT_ERRORS"
+#define CBLT_RESYNCS_STR "CBLT_RESYNCS"
+#define SOFTWARE_EVENT_RESET_STR "SOFTWARE_EVENT_RESET"
+
+/// \brief Crate-level group of V1290N boards sharing one MCST/CBLT address.
+///
+/// Boards are added in chain (slot) order. Configuration written to the group port is
+/// broadcast to every board with one MCST cycle per register or micro word; Control is the
+/// exception, it is written per board so each keeps its readout bits. While CBLT is enabled the group's readout thread
+/// reads one event from every board with a single chained block transfer per trigger and
+/// demultiplexes the data into each board's ring by the GEO address in the global headers.
+class CaenV1290NGroup : public asynPortDriver {
+  public:
+    CaenV1290NGroup(const char* portName, int cbltAddr);
+    virtual void poll();
+    virtual void readout();
+    virtual asynStatus writeInt32(asynUser* pasynUser, epicsInt32 value);
+    virtual asynStatus writeUInt32Digital(asynUser* pasynUser, epicsUInt32 value, epicsUInt32 mask);
+
+    /// \brief Appends a board to the end of the chain.
+    /// \param board The board driver.
+    /// \param geo GEO address to program, or 0 to use the one already set (e.g. from JAUX).
+    /// \return True on success, false on error.
+    bool add_board(CaenV1290N* board, int geo);
+
+  private:
+    // this is a "trick" since adding an offset like 0x1000 to a pointer to uint8_t moves 4 bytes
+    volatile uint8_t* base;
+
+    /// \brief Programs every board's MCST/CBLT address and its position in the chain.
+    bool program_chain();
+
+    /// \brief Hands readout of every board to the group, or gives it back.
+    bool configure_cblt(bool enable);
+
+    /// \brief Performs an MCST D16 write of the value to the offset on every board.
+    bool mcst_writeD16(uint16_t offset, uint16_t value) {
+        return !devWriteProbe(sizeof(uint16_t), base + offset, &value);
+    }
+
+    /// \brief Waits until every board's micro controller accepts a write.
+    bool wait_all_micro();
+
+    /// \brief Broadcasts an opcode, followed by nvals data words, to every board's micro register.
+    /// \return True on success, false on error or timeout on any board.
+    bool mcst_write_micro(uint16_t opcode, const uint16_t* vals = NULL, size_t nvals = 0);
+
+    /// \brief Transfers exactly n words through the CBLT window.
+    size_t transfer_words(uint32_t* dst, size_t n);
+
+    /// \brief Splits the words of one CBLT cycle into per-board events and hands them over.
+    void demux(const uint32_t* words, size_t n);
+
+    uint16_t cbltAddr_;
+    std::vector<CaenV1290N*> boards_;
+    CaenV1290N* byGeo_[DataWord::GeoMask + 1];
+    std::vector<uint32_t> buf_;
+    volatile int enabled_;
+    size_t cycles_;
+    size_t words_;
+    size_t errors_;
+    size_t resyncs_; // Cycles read without every board, see group_sync_timeout_sec
+
+  protected:
+    int cbltEnableId_;
+    int numBoardsId_;
+    int cbltCyclesId_;
+    int cbltWordsId_;
+    int cbltErrorsId_;
+    int cbltResyncsId_;
+    int acquisitionModeId_;
+    int edgeDetectModeId_;
+    int enablePatternId_;
+    int windowWidthId_;
+    int windowOffsetId_;
+    int tdcHeaderTrailerId_;
+    int controlId_;
+    int softwareClearId_;
+    int softwareEventResetId_;
+};